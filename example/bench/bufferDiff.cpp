@@ -0,0 +1,68 @@
+// Bytes sent and time taken to make a large buffer match a slightly edited
+// copy of it, through setBufferLines versus a full nvim_buf_set_lines.
+// Usage: bench_bufferDiff [host [port [lines]]]
+#include "common.hpp"
+
+using SetLines = nvimRpc::packer::PackedRequest<int64_t, int64_t, int64_t, bool, nvimRpc::diff::Lines>;
+using CallAtomic = nvimRpc::packer::PackedRequest<nvimRpc::diff::BufferEdits>;
+
+// a few scattered line changes, one insertion and one deletion
+static nvimRpc::diff::Lines edited(nvimRpc::diff::Lines lines) {
+	for (size_t i = 0; i < lines.size(); i += lines.size() / 8 + 1) {
+		lines[i] += " edited";
+	}
+	lines.insert(lines.begin() + lines.size() / 3, "inserted");
+	lines.erase(lines.begin() + lines.size() / 2);
+	return lines;
+}
+
+int main(int argc, char **argv) {
+	size_t lineCount = argc > 3 ? std::atoi(argv[3]) : 200000;
+	nvimRpc::diff::Lines current = bench::makeLines(lineCount, 80);
+	nvimRpc::diff::Lines desired = edited(current);
+	std::pmr::memory_resource *resource = std::pmr::get_default_resource();
+
+	auto start = bench::Clock::now();
+	nvimRpc::diff::BufferEdits bufferEdits{0, nvimRpc::diff::computeEdits(current, desired)};
+	double diffUs = bench::elapsedUs(start);
+
+	SetLines setLines("nvim_buf_set_lines", 0, resource, 0, 0, -1, true, desired);
+	CallAtomic callAtomic("nvim_call_atomic", 0, resource, bufferEdits);
+	std::cout << "lines=" << lineCount << " edits=" << bufferEdits.edits.size()
+		<< " diff=" << std::fixed << std::setprecision(1) << diffUs << "us" << std::endl;
+	std::cout << "bytes sent: nvim_buf_set_lines=" << setLines.size()
+		<< " setBufferLines=" << callAtomic.size() << std::endl;
+
+	nvimRpc::Client *client = new nvimRpc::Client(bench::connector(argc, argv));
+	try {
+		client->connect();
+		const int rounds = 20;
+		std::vector<double> full;
+		std::vector<double> diffed;
+
+		for (int i = 0; i < rounds; i++) {
+			client->call<nvimRpc::packer::Void>("nvim_buf_set_lines", 0, 0, -1, true, current).get();
+			start = bench::Clock::now();
+			client->call<nvimRpc::packer::Void>("nvim_buf_set_lines", 0, 0, -1, true, desired).get();
+			full.push_back(bench::elapsedUs(start));
+
+			client->call<nvimRpc::packer::Void>("nvim_buf_set_lines", 0, 0, -1, true, current).get();
+			start = bench::Clock::now();
+			client->setBufferLines(0, current, desired).get();
+			diffed.push_back(bench::elapsedUs(start));
+		}
+		bench::printLatencies("full nvim_buf_set_lines", full);
+		bench::printLatencies("setBufferLines, content known", diffed);
+
+		client->call<nvimRpc::packer::Void>("nvim_buf_set_lines", 0, 0, -1, true, current).get();
+		start = bench::Clock::now();
+		client->setBufferLines(0, desired).get();
+		bench::printLatencies("setBufferLines, content fetched", {bench::elapsedUs(start)});
+		client->disconnect();
+	} catch (std::exception &e) {
+		std::cerr << "benchmark failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef BENCH_COMMON
+#define BENCH_COMMON
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "nvimClient.hpp"
+
+namespace bench {
+using Clock = std::chrono::steady_clock;
+
+inline double elapsedUs(Clock::time_point start) {
+	return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+inline double percentile(const std::vector<double> &sorted, double p) {
+	if (sorted.empty()) {
+		return 0;
+	}
+	return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p / 100 * sorted.size()))];
+}
+
+inline void printLatencies(const std::string &label, std::vector<double> latencies) {
+	std::sort(latencies.begin(), latencies.end());
+	std::cout << std::left << std::setw(40) << label << std::right << std::fixed << std::setprecision(1)
+		<< " n=" << latencies.size()
+		<< " p50=" << percentile(latencies, 50) << "us"
+		<< " p99=" << percentile(latencies, 99) << "us"
+		<< " p99.9=" << percentile(latencies, 99.9) << "us"
+		<< " max=" << (latencies.empty() ? 0 : latencies.back()) << "us" << std::endl;
+}
+
+// nvim to talk to, from the command line: [host [port]]
+inline Tcp::Connector *connector(int argc, char **argv) {
+	std::string host = argc > 1 ? argv[1] : "127.0.0.1";
+	int port = argc > 2 ? std::atoi(argv[2]) : 6666;
+
+	return new Tcp::Connector(host, port);
+}
+
+inline std::vector<std::string> makeLines(size_t count, size_t width) {
+	std::vector<std::string> lines;
+
+	lines.reserve(count);
+	for (size_t i = 0; i < count; i++) {
+		std::string line = std::to_string(i) + " ";
+		line.resize(width, 'x');
+		lines.push_back(line);
+	}
+	return lines;
+}
+} // namespace bench
+
+#endif /* !BENCH_COMMON */
@@ -0,0 +1,55 @@
+// Latency of small calls while large nvim_buf_get_lines responses are being
+// decoded. Usage: bench_dispatchTailLatency [host [port [workers]]]
+#include <atomic>
+#include <thread>
+
+#include "common.hpp"
+
+static std::vector<double> smallCallLatencies(nvimRpc::Client *client, size_t count) {
+	std::vector<double> latencies;
+
+	for (size_t i = 0; i < count; i++) {
+		auto start = bench::Clock::now();
+		client->call<int64_t>("nvim_eval", std::string("1")).get();
+		latencies.push_back(bench::elapsedUs(start));
+	}
+	return latencies;
+}
+
+int main(int argc, char **argv) {
+	size_t workers = argc > 3 ? std::atoi(argv[3]) : std::thread::hardware_concurrency();
+	nvimRpc::Client *client = new nvimRpc::Client(bench::connector(argc, argv), workers);
+	const size_t smallCalls = 5000;
+
+	try {
+		client->connect();
+		client->call<nvimRpc::packer::Void>("nvim_buf_set_lines", 0, 0, -1, true, bench::makeLines(200000, 80)).get();
+
+		bench::printLatencies("small calls, idle", smallCallLatencies(client, smallCalls));
+
+		std::atomic<bool> stop(false);
+		std::atomic<size_t> largeReads(0);
+		std::vector<std::thread> readers;
+		for (int i = 0; i < 2; i++) {
+			readers.emplace_back([client, &stop, &largeReads]() {
+				while (!stop) {
+					client->call<std::vector<std::string>>("nvim_buf_get_lines", 0, 0, -1, true).get();
+					largeReads++;
+				}
+			});
+		}
+
+		bench::printLatencies("small calls, concurrent 16MB reads", smallCallLatencies(client, smallCalls));
+		stop = true;
+		for (auto &reader : readers) {
+			reader.join();
+		}
+		std::cout << "workers=" << workers << " large reads completed=" << largeReads << std::endl;
+		client->disconnect();
+	} catch (std::exception &e) {
+		std::cerr << "benchmark failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,41 @@
+// Round trip of requests made by nvim to the client (rpcrequest), as seen
+// from nvim: a Lua loop calls an echo handler and times itself.
+// Usage: bench_inboundRequests [host [port [requests]]]
+#include "common.hpp"
+
+// runs the given number of rpcrequest() on the channel of the calling
+// client, returns the elapsed nanoseconds
+constexpr const char *REQUEST_LOOP = "local count = ...\n"
+                                     "local channel = vim.api.nvim_get_chan_info(0).id\n"
+                                     "local start = vim.loop.hrtime()\n"
+                                     "for i = 1, count do\n"
+                                     "  assert(vim.rpcrequest(channel, 'echo', i) == i)\n"
+                                     "end\n"
+                                     "return vim.loop.hrtime() - start\n";
+
+int main(int argc, char **argv) {
+	int64_t requests = argc > 3 ? std::atoi(argv[3]) : 20000;
+	nvimRpc::Client *client = new nvimRpc::Client(bench::connector(argc, argv));
+
+	client->onRequest("echo", [](const nvimRpc::packer::PackedRequestResponse &request, nvimRpc::packer::Packer &result) {
+		result << request.params().via.array.ptr[0];
+	});
+	try {
+		client->connect();
+		auto start = bench::Clock::now();
+		int64_t elapsedNs = client->call<int64_t>("nvim_exec_lua", std::string(REQUEST_LOOP),
+			std::make_tuple(requests)).get();
+		double totalUs = bench::elapsedUs(start);
+
+		std::cout << "requests=" << requests << std::fixed << std::setprecision(2)
+			<< " round trip=" << elapsedNs / 1000.0 / requests << "us"
+			<< " requests/s=" << std::setprecision(0) << requests / (elapsedNs / 1e9)
+			<< " (client side total " << totalUs / 1000 << "ms)" << std::endl;
+		client->disconnect();
+	} catch (std::exception &e) {
+		std::cerr << "benchmark failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
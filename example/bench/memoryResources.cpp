@@ -0,0 +1,110 @@
+// Allocations made per call, from packing the request to taking its decoded
+// result, for the memory resources a Client can be given. Runs without nvim,
+// responses are decoded from a prebuilt frame.
+// Usage: bench_memoryResources [iterations [lines]]
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "common.hpp"
+
+// every global operator new, i.e. what the default resource ends up calling.
+// msgpack's zones use malloc directly and are not counted.
+static std::atomic<size_t> globalAllocations(0);
+
+void *operator new(size_t size) {
+	globalAllocations++;
+	if (void *p = std::malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+class CountingResource : public std::pmr::memory_resource {
+	private:
+		std::pmr::memory_resource *_upstream;
+		std::atomic<size_t> _allocations;
+
+	protected:
+		void *do_allocate(size_t bytes, size_t alignment) override {
+			_allocations++;
+			return _upstream->allocate(bytes, alignment);
+		}
+
+		void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+			_upstream->deallocate(p, bytes, alignment);
+		}
+
+		bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+	public:
+		CountingResource(std::pmr::memory_resource *upstream) : _upstream(upstream), _allocations(0) {}
+
+		size_t allocations() const { return _allocations; }
+};
+
+using Lines = std::pmr::vector<std::pmr::string>;
+using GetLines = nvimRpc::packer::PackedRequest<int64_t, int64_t, int64_t, bool>;
+using GetLinesCall = dispatcher::Call<Lines, int64_t, int64_t, int64_t, bool>;
+
+// one nvim_buf_get_lines round trip minus the socket: what the client and the
+// dispatcher's worker allocate for it
+static size_t roundTrip(std::pmr::memory_resource *resource, const msgpack::sbuffer &response, uint64_t msgid) {
+	auto request = std::allocate_shared<GetLines>(std::pmr::polymorphic_allocator<GetLines>(resource),
+		"nvim_buf_get_lines", msgid, resource, 0, 0, -1, true);
+	GetLinesCall *call = GetLinesCall::create(request);
+	auto future = call->getFuture();
+
+	nvimRpc::packer::PackedRequestResponse packedResponse(msgpack::unpack(response.data(), response.size()), resource);
+	call->fulfillPromise(packedResponse);
+	call->destroy();
+	return future.get().size();
+}
+
+static void run(const std::string &label, std::pmr::memory_resource *resource, const msgpack::sbuffer &response,
+		size_t iterations, std::function<void()> endOfBatch = nullptr) {
+	CountingResource counting(resource);
+	size_t allocationsBefore = globalAllocations;
+	auto start = bench::Clock::now();
+
+	for (size_t i = 0; i < iterations; i++) {
+		roundTrip(&counting, response, i);
+		if (endOfBatch && i % 64 == 63) {
+			endOfBatch();
+		}
+	}
+
+	double us = bench::elapsedUs(start);
+	std::cout << std::left << std::setw(40) << label << std::right << std::fixed << std::setprecision(1)
+		<< " resource allocations/call=" << static_cast<double>(counting.allocations()) / iterations
+		<< " operator new/call=" << static_cast<double>(globalAllocations - allocationsBefore) / iterations
+		<< " calls/s=" << iterations / (us / 1e6) << std::endl;
+}
+
+int main(int argc, char **argv) {
+	size_t iterations = argc > 1 ? std::atoi(argv[1]) : 20000;
+	size_t lineCount = argc > 2 ? std::atoi(argv[2]) : 100;
+	msgpack::sbuffer response;
+	msgpack::packer<msgpack::sbuffer> pk(response);
+
+	pk.pack_array(4) << (uint64_t)nvimRpc::packer::RESPONSE << (uint64_t)0;
+	pk.pack_nil();
+	pk << bench::makeLines(lineCount, 80);
+
+	run("new_delete_resource", std::pmr::new_delete_resource(), response, iterations);
+
+	std::pmr::synchronized_pool_resource pool;
+	run("synchronized_pool_resource", &pool, response, iterations);
+
+	// an arena released every 64 calls, made usable from several threads
+	std::pmr::monotonic_buffer_resource arena(1 << 20);
+	nvimRpc::memory::SynchronizedResource synchronizedArena(&arena);
+	run("SynchronizedResource(monotonic arena)", &synchronizedArena, response, iterations,
+		[&arena]() { arena.release(); });
+
+	return 0;
+}
@@ -0,0 +1,37 @@
+// Round trip latency of small blocking calls: callSync (the caller reads its
+// own response) versus call().get() (the listening thread reads it and a
+// worker fulfills the promise).
+// Usage: bench_pingPong [host [port [calls]]]
+#include "common.hpp"
+
+int main(int argc, char **argv) {
+	size_t calls = argc > 3 ? std::atoi(argv[3]) : 20000;
+	nvimRpc::Client *client = new nvimRpc::Client(bench::connector(argc, argv));
+
+	try {
+		client->connect();
+		// alternate rounds so both see the same nvim and machine state
+		std::vector<double> futures;
+		std::vector<double> sync;
+		for (int round = 0; round < 4; round++) {
+			for (size_t i = 0; i < calls / 4; i++) {
+				auto start = bench::Clock::now();
+				client->call<int64_t>("nvim_eval", std::string("1")).get();
+				futures.push_back(bench::elapsedUs(start));
+			}
+			for (size_t i = 0; i < calls / 4; i++) {
+				auto start = bench::Clock::now();
+				client->callSync<int64_t>("nvim_eval", std::string("1"));
+				sync.push_back(bench::elapsedUs(start));
+			}
+		}
+		bench::printLatencies("call().get()", futures);
+		bench::printLatencies("callSync()", sync);
+		client->disconnect();
+	} catch (std::exception &e) {
+		std::cerr << "benchmark failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
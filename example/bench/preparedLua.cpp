@@ -0,0 +1,63 @@
+// Bytes sent and latency of a Lua chunk run through callPrepared versus
+// nvim_exec_lua sending its code every time.
+// Usage: bench_preparedLua [host [port [calls]]]
+#include "common.hpp"
+
+// some real world sized chunk: the longest line of a buffer range
+static std::string chunkCode() {
+	std::string code = "local buffer, first, last = ...\n"
+	                   "local longest, length = 0, 0\n"
+	                   "for i, line in ipairs(vim.api.nvim_buf_get_lines(buffer, first, last, false)) do\n"
+	                   "  if #line > length then longest, length = first + i - 1, #line end\n"
+	                   "end\n"
+	                   "return {longest, length}\n";
+
+	// padding standing for helpers and comments such chunks carry
+	for (int i = 0; i < 20; i++) {
+		code += "-- helper " + std::to_string(i) + ": " + std::string(60, '-') + "\n";
+	}
+	return code;
+}
+
+using Args = std::tuple<int64_t, int64_t, int64_t>;
+using Result = std::tuple<int64_t, int64_t>;
+
+int main(int argc, char **argv) {
+	size_t calls = argc > 3 ? std::atoi(argv[3]) : 5000;
+	nvimRpc::lua::PreparedChunk chunk(chunkCode());
+	std::pmr::memory_resource *resource = std::pmr::get_default_resource();
+
+	nvimRpc::packer::PackedRequest<std::string, Args> plain("nvim_exec_lua", 0, resource, chunk.code(), Args(0, 0, 100));
+	nvimRpc::packer::PackedRequest<std::string, std::tuple<std::string, int64_t, int64_t, int64_t>> prepared(
+		"nvim_exec_lua", 0, resource, std::string(nvimRpc::lua::CALL_PREPARED),
+		std::make_tuple(chunk.key(), (int64_t)0, (int64_t)0, (int64_t)100));
+	std::cout << "bytes per call: nvim_exec_lua=" << plain.size() << " callPrepared=" << prepared.size() << std::endl;
+
+	nvimRpc::Client *client = new nvimRpc::Client(bench::connector(argc, argv));
+	try {
+		client->connect();
+		client->call<nvimRpc::packer::Void>("nvim_buf_set_lines", 0, 0, -1, true, bench::makeLines(1000, 80)).get();
+
+		std::vector<double> plainLatencies;
+		for (size_t i = 0; i < calls; i++) {
+			auto start = bench::Clock::now();
+			client->call<Result>("nvim_exec_lua", chunk.code(), Args(0, 0, 100)).get();
+			plainLatencies.push_back(bench::elapsedUs(start));
+		}
+		bench::printLatencies("nvim_exec_lua", plainLatencies);
+
+		std::vector<double> preparedLatencies;
+		for (size_t i = 0; i < calls; i++) {
+			auto start = bench::Clock::now();
+			client->callPrepared<Result>(chunk, (int64_t)0, (int64_t)0, (int64_t)100).get();
+			preparedLatencies.push_back(bench::elapsedUs(start));
+		}
+		bench::printLatencies("callPrepared", preparedLatencies);
+		client->disconnect();
+	} catch (std::exception &e) {
+		std::cerr << "benchmark failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
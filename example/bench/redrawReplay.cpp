@@ -0,0 +1,103 @@
+// Time spent by redraw::Ui decoding redraw notifications. Replays the redraw
+// notifications of a recorded msgpack-rpc stream (e.g. what nvim sent to a
+// ui, captured with socat) or, without one, synthesized full screen scrolls.
+// Usage: bench_redrawReplay [recording]
+#include <fstream>
+#include <iterator>
+
+#include "common.hpp"
+
+static std::vector<msgpack::object_handle> recorded(const std::string &path) {
+	std::ifstream file(path, std::ios::binary);
+	std::string stream((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	std::vector<msgpack::object_handle> notifications;
+	size_t offset = 0;
+
+	while (offset < stream.size()) {
+		msgpack::object_handle message = msgpack::unpack(stream.data(), stream.size(), offset);
+		const msgpack::object &frame = message.get();
+
+		if (frame.type == msgpack::type::ARRAY && frame.via.array.size == 3 &&
+				frame.via.array.ptr[0].as<uint64_t>() == nvimRpc::packer::NOTIFY &&
+				frame.via.array.ptr[1].as<std::string>() == "redraw") {
+			notifications.push_back(std::move(message));
+		}
+	}
+	return notifications;
+}
+
+// params of one redraw batch: the screen scrolls up a line, the new last line
+// is drawn with a highlight change every 8 cells, then flush
+static msgpack::object_handle scrollBatch(size_t width, size_t height, size_t batch) {
+	msgpack::sbuffer buffer;
+	msgpack::packer<msgpack::sbuffer> pk(buffer);
+
+	pk.pack_array(3);
+	pk.pack_array(2) << std::string("grid_scroll");
+	pk.pack_array(7) << 1 << 0 << height << 0 << width << 1 << 0;
+	pk.pack_array(2) << std::string("grid_line");
+	pk.pack_array(4) << 1 << height - 1 << 0;
+	pk.pack_array(width);
+	for (size_t col = 0; col < width; col++) {
+		std::string text(1, 'a' + (batch + col) % 26);
+
+		if (col % 8 == 0) {
+			pk.pack_array(2) << text << (col / 8) % 4 + 1;
+		} else {
+			pk.pack_array(1) << text;
+		}
+	}
+	pk.pack_array(2) << std::string("flush");
+	pk.pack_array(0);
+	return msgpack::unpack(buffer.data(), buffer.size());
+}
+
+static msgpack::object_handle setup(size_t width, size_t height) {
+	msgpack::sbuffer buffer;
+	msgpack::packer<msgpack::sbuffer> pk(buffer);
+
+	pk.pack_array(1);
+	pk.pack_array(2) << std::string("grid_resize");
+	pk.pack_array(3) << 1 << width << height;
+	return msgpack::unpack(buffer.data(), buffer.size());
+}
+
+int main(int argc, char **argv) {
+	nvimRpc::redraw::Ui ui;
+	std::vector<msgpack::object_handle> batches;
+	size_t flushes = 0;
+
+	ui.onFlush([&flushes](nvimRpc::redraw::Ui &) { flushes++; });
+	if (argc > 1) {
+		for (auto &notification : recorded(argv[1])) {
+			batches.push_back(std::move(notification));
+		}
+	} else {
+		const size_t width = 200;
+		const size_t height = 60;
+
+		ui.handleRedraw(setup(width, height).get());
+		for (size_t batch = 0; batch < 1000; batch++) {
+			batches.push_back(scrollBatch(width, height, batch));
+		}
+	}
+
+	std::vector<double> latencies;
+	auto start = bench::Clock::now();
+	for (int round = 0; round < 10; round++) {
+		for (const auto &batch : batches) {
+			auto batchStart = bench::Clock::now();
+			// recorded frames are [2, "redraw", params]
+			const msgpack::object &params = argc > 1 ? batch.get().via.array.ptr[2] : batch.get();
+
+			ui.handleRedraw(params);
+			latencies.push_back(bench::elapsedUs(batchStart));
+		}
+	}
+	double totalUs = bench::elapsedUs(start);
+
+	bench::printLatencies(argc > 1 ? "recorded redraw notifications" : "synthesized scroll batches", latencies);
+	std::cout << "notifications/s=" << std::fixed << std::setprecision(0) << latencies.size() / (totalUs / 1e6)
+		<< " flushes=" << flushes << std::endl;
+	return 0;
+}
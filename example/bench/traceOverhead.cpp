@@ -0,0 +1,58 @@
+// Cost of the tracing hooks on the request path, per request (one
+// recordPacked and seven record), with tracing disabled, enabled but the
+// request not sampled, and sampled. Runs without nvim.
+// Each thread traces the given number of requests, the time reported is the
+// wall time per request of one thread.
+// Usage: bench_traceOverhead [requests [threads]]
+#include <thread>
+
+#include "common.hpp"
+
+using namespace nvimRpc::trace;
+
+// the hooks one request goes through in the client and the dispatcher
+static void traceRequests(uint64_t firstId, size_t requests) {
+	const std::string method("nvim_buf_get_lines");
+
+	for (uint64_t id = firstId; id < firstId + requests; id++) {
+		record(id, PACKING);
+		recordPacked(id, method, 64);
+		record(id, ENQUEUED);
+		record(id, LOCKED);
+		record(id, SENT);
+		record(id, FRAME_READ);
+		record(id, DECODED);
+		record(id, FULFILLED);
+	}
+}
+
+static void run(const std::string &label, size_t requests, size_t threadCount) {
+	std::vector<std::thread> threads;
+	auto start = bench::Clock::now();
+
+	for (size_t i = 0; i < threadCount; i++) {
+		threads.emplace_back(traceRequests, i * requests, requests);
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	double us = bench::elapsedUs(start);
+	std::cout << std::left << std::setw(40) << label << std::right << std::fixed << std::setprecision(1)
+		<< " threads=" << threadCount << " ns/request=" << us * 1000 / requests << std::endl;
+}
+
+int main(int argc, char **argv) {
+	size_t requests = argc > 1 ? std::atoi(argv[1]) : 1000000;
+	size_t threadCount = argc > 2 ? std::atoi(argv[2]) : 4;
+
+	for (size_t threads : {static_cast<size_t>(1), threadCount}) {
+		Tracer::instance().disable();
+		run("disabled", requests, threads);
+		Tracer::instance().enable(1000);
+		run("enabled, 1 request in 1000 sampled", requests, threads);
+		Tracer::instance().enable(1);
+		run("enabled, every request sampled", requests, threads);
+	}
+	Tracer::instance().disable();
+	return 0;
+}
@@ -0,0 +1,53 @@
+// Bytes copied while packing 20MB nvim_buf_set_lines requests, with lines
+// below and above PackedRequest's reference threshold, and the time taken to
+// pack and send them.
+// Usage: bench_zeroCopy [host [port]]
+#include "common.hpp"
+
+using SetLines = nvimRpc::packer::PackedRequest<int64_t, int64_t, int64_t, bool, std::vector<std::string>>;
+
+static void packing(const std::string &label, const std::vector<std::string> &lines) {
+	auto start = bench::Clock::now();
+	SetLines request("nvim_buf_set_lines", 0, std::pmr::get_default_resource(), 0, 0, -1, true, lines);
+	double us = bench::elapsedUs(start);
+	size_t segments = 0;
+
+	request.buffer().forEachSegment([&segments](const char *, size_t) { segments++; });
+	std::cout << std::left << std::setw(40) << label << std::right << " size=" << request.size()
+		<< " copied=" << request.buffer().copiedSize() << " segments=" << segments
+		<< " pack=" << std::fixed << std::setprecision(1) << us / 1000 << "ms" << std::endl;
+}
+
+static void sending(nvimRpc::Client *client, const std::string &label, const std::vector<std::string> &lines) {
+	std::vector<double> latencies;
+
+	for (int i = 0; i < 10; i++) {
+		auto start = bench::Clock::now();
+		client->call<nvimRpc::packer::Void>("nvim_buf_set_lines", 0, 0, -1, true, lines).get();
+		latencies.push_back(bench::elapsedUs(start));
+	}
+	bench::printLatencies(label, latencies);
+}
+
+int main(int argc, char **argv) {
+	const size_t total = 20 * 1024 * 1024;
+	// typical source lines are copied, 4KB ones are referenced
+	auto shortLines = bench::makeLines(total / 80, 80);
+	auto longLines = bench::makeLines(total / 4096, 4096);
+
+	packing("20MB in 80 byte lines", shortLines);
+	packing("20MB in 4KB lines", longLines);
+
+	nvimRpc::Client *client = new nvimRpc::Client(bench::connector(argc, argv));
+	try {
+		client->connect();
+		sending(client, "set_lines 20MB in 80 byte lines", shortLines);
+		sending(client, "set_lines 20MB in 4KB lines", longLines);
+		client->disconnect();
+	} catch (std::exception &e) {
+		std::cerr << "benchmark failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,160 @@
+// diff::computeEdits against a model of nvim_buf_set_lines/nvim_buf_set_text,
+// and the nvim_call_atomic payload and response handling of BufferEdits
+#include <random>
+#include <string>
+
+#include "common.hpp"
+#include "impl/BufferDiff.hpp"
+
+using nvimRpc::diff::Edit;
+using nvimRpc::diff::Lines;
+
+// applies the edits in order, the way nvim would
+static Lines applyEdits(Lines lines, const std::vector<Edit> &edits) {
+	for (const auto &edit : edits) {
+		if (edit.linewise) {
+			lines.erase(lines.begin() + edit.startRow, lines.begin() + edit.endRow);
+			lines.insert(lines.begin() + edit.startRow, edit.replacement.begin(), edit.replacement.end());
+			continue;
+		}
+
+		Lines replacement = edit.replacement;
+		replacement.front() = lines[edit.startRow].substr(0, edit.startCol) + replacement.front();
+		replacement.back() += lines[edit.endRow].substr(edit.endCol);
+		lines.erase(lines.begin() + edit.startRow, lines.begin() + edit.endRow + 1);
+		lines.insert(lines.begin() + edit.startRow, replacement.begin(), replacement.end());
+	}
+	return lines;
+}
+
+static void randomEdits() {
+	std::mt19937 random(1);
+
+	for (int i = 0; i < 20000; i++) {
+		Lines current;
+		size_t lineCount = random() % 12;
+		for (size_t j = 0; j < lineCount; j++) {
+			current.push_back(std::string(1 + random() % 3, 'a' + random() % 3));
+		}
+
+		Lines desired = current;
+		for (int changes = random() % 5; changes > 0; changes--) {
+			int change = random() % 4;
+
+			if (change == 0) {
+				desired.insert(desired.begin() + random() % (desired.size() + 1), std::string(random() % 3, 'a' + random() % 3));
+			} else if (change == 1 && !desired.empty()) {
+				desired.erase(desired.begin() + random() % desired.size());
+			} else if (!desired.empty()) {
+				desired[random() % desired.size()] += "xy";
+			}
+		}
+
+		// a tiny edit distance forces the whole middle to be replaced
+		size_t maxEditDistance = i % 3 == 0 ? 1 : 1024;
+		CHECK(applyEdits(current, nvimRpc::diff::computeEdits(current, desired, maxEditDistance)) == desired);
+	}
+}
+
+static void largeBuffer() {
+	Lines current;
+	for (size_t i = 0; i < 100000; i++) {
+		current.push_back("line " + std::to_string(i));
+	}
+
+	Lines desired = current;
+	desired[500] = "changed";
+	desired.insert(desired.begin() + 90000, "inserted");
+	desired.erase(desired.begin() + 50000);
+
+	auto edits = nvimRpc::diff::computeEdits(current, desired);
+	CHECK(edits.size() == 3);
+	CHECK(applyEdits(current, edits) == desired);
+	CHECK(nvimRpc::diff::computeEdits(current, current).empty());
+}
+
+static void characterRefinement() {
+	auto edits = nvimRpc::diff::computeEdits({"hello world"}, {"hello there world"});
+
+	CHECK(edits.size() == 1);
+	CHECK(!edits[0].linewise);
+	CHECK(edits[0].startRow == 0 && edits[0].startCol == 6);
+	CHECK(edits[0].endRow == 0 && edits[0].endCol == 6);
+	CHECK(edits[0].replacement == Lines{"there "});
+
+	// "é" and "è" share their first byte, the edit must not split them
+	edits = nvimRpc::diff::computeEdits({"caf\xc3\xa9"}, {"caf\xc3\xa8"});
+	CHECK(edits.size() == 1);
+	CHECK(edits[0].startCol == 3 && edits[0].endCol == 5);
+	CHECK(edits[0].replacement == Lines{"\xc3\xa8"});
+}
+
+static msgpack::object_handle packed(const nvimRpc::diff::BufferEdits &bufferEdits) {
+	msgpack::sbuffer buffer;
+
+	msgpack::pack(buffer, bufferEdits);
+	return msgpack::unpack(buffer.data(), buffer.size());
+}
+
+static void atomicPayload() {
+	nvimRpc::diff::BufferEdits bufferEdits{3, nvimRpc::diff::computeEdits({"a", "b"}, {"a", "c", "d"})};
+
+	auto calls = packed(bufferEdits);
+	CHECK(calls.get().via.array.size == bufferEdits.edits.size());
+	CHECK(calls.get().via.array.ptr[0].via.array.ptr[0].as<std::string>() == "nvim_buf_set_text");
+
+	bufferEdits.changedtick = 42;
+	auto guardedCalls = packed(bufferEdits);
+	const msgpack::object &guard = guardedCalls.get().via.array.ptr[0];
+	CHECK(guardedCalls.get().via.array.size == bufferEdits.edits.size() + 1);
+	CHECK(guard.via.array.ptr[0].as<std::string>() == "nvim_exec_lua");
+	CHECK(guard.via.array.ptr[1].via.array.ptr[1].via.array.ptr[0].as<int64_t>() == 3);
+	CHECK(guard.via.array.ptr[1].via.array.ptr[1].via.array.ptr[1].as<int64_t>() == 42);
+}
+
+// [results, error] as nvim_call_atomic answers, error being nil or [index, type, message]
+static msgpack::object_handle atomicResponse(size_t results, int64_t failedIndex) {
+	msgpack::sbuffer buffer;
+	msgpack::packer<msgpack::sbuffer> pk(buffer);
+
+	pk.pack_array(2);
+	pk.pack_array(results);
+	for (size_t i = 0; i < results; i++) {
+		pk.pack_nil();
+	}
+	if (failedIndex < 0) {
+		pk.pack_nil();
+	} else {
+		pk.pack_array(3) << failedIndex << (int64_t)0 << std::string("boom");
+	}
+	return msgpack::unpack(buffer.data(), buffer.size());
+}
+
+static std::string errorOf(const msgpack::object_handle &response, bool guarded) {
+	try {
+		nvimRpc::diff::editResults(response.get(), guarded);
+	} catch (std::runtime_error &e) {
+		return e.what();
+	}
+	return "";
+}
+
+static void atomicResults() {
+	CHECK(nvimRpc::diff::editResults(atomicResponse(2, -1).get(), false).size() == 2);
+	// the guard's own result is not one of the edits'
+	CHECK(nvimRpc::diff::editResults(atomicResponse(3, -1).get(), true).size() == 2);
+
+	CHECK(errorOf(atomicResponse(1, 1), false) == "edit 1 failed: boom");
+	CHECK(errorOf(atomicResponse(1, 1), true) == "edit 0 failed: boom");
+	CHECK(errorOf(atomicResponse(0, 0), true) == "buffer changed since it was read: boom");
+}
+
+int main() {
+	randomEdits();
+	largeBuffer();
+	characterRefinement();
+	atomicPayload();
+	atomicResults();
+
+	return test::report("bufferDiff");
+}
@@ -0,0 +1,25 @@
+#ifndef TEST_COMMON
+#define TEST_COMMON
+
+#include <iostream>
+
+#define CHECK(condition) test::check((condition), #condition, __FILE__, __LINE__)
+
+namespace test {
+inline int failures = 0;
+
+inline void check(bool passed, const char *condition, const char *file, int line) {
+	if (!passed) {
+		std::cerr << file << ":" << line << ": check failed: " << condition << std::endl;
+		failures++;
+	}
+}
+
+// exit status of the test program
+inline int report(const char *name) {
+	std::cout << name << (failures ? ": FAILED" : ": ok") << std::endl;
+	return failures ? 1 : 0;
+}
+} // namespace test
+
+#endif /* !TEST_COMMON */
@@ -0,0 +1,159 @@
+// redraw::Grid operations and damage tracking, glyph and highlight interning,
+// and the decoding of redraw notifications by redraw::Ui
+#include <string>
+
+#include "common.hpp"
+#include "impl/Redraw.hpp"
+
+using nvimRpc::redraw::DamagedRegion;
+using nvimRpc::redraw::Grid;
+
+// rows filled with 'a', 'b', 'c'... and highlighted with their index
+static Grid lettered(size_t width, size_t height) {
+	Grid grid;
+
+	grid.resize(width, height);
+	for (size_t row = 0; row < height; row++) {
+		grid.fill(row, 0, width, 'a' + row, row);
+	}
+	grid.clearDamage();
+	return grid;
+}
+
+static std::vector<DamagedRegion> damage(const Grid &grid) {
+	std::vector<DamagedRegion> regions;
+
+	grid.forEachDamagedRegion([&regions](DamagedRegion region) { regions.push_back(region); });
+	return regions;
+}
+
+static void scrollUp() {
+	Grid grid = lettered(3, 5);
+
+	// rows 1 to 4 up by 2
+	grid.scroll(1, 5, 0, 3, 2);
+	CHECK(grid.glyph(0, 0) == 'a');
+	CHECK(grid.glyph(1, 0) == 'd' && grid.highlight(1, 0) == 3);
+	CHECK(grid.glyph(2, 2) == 'e' && grid.highlight(2, 2) == 4);
+	// left behind until nvim redraws them
+	CHECK(grid.glyph(3, 0) == 'd' && grid.glyph(4, 0) == 'e');
+
+	auto regions = damage(grid);
+	CHECK(regions.size() == 2);
+	CHECK(regions[0].row == 1 && regions[0].startCol == 0 && regions[0].endCol == 3);
+	CHECK(regions[1].row == 2);
+}
+
+static void scrollDown() {
+	Grid grid = lettered(3, 5);
+
+	// columns 1 and 2 of every row down by 1
+	grid.scroll(0, 5, 1, 3, -1);
+	CHECK(grid.glyph(1, 1) == 'a' && grid.glyph(1, 0) == 'b');
+	CHECK(grid.glyph(4, 2) == 'd' && grid.glyph(4, 0) == 'e');
+	CHECK(grid.glyph(0, 1) == 'a');
+
+	auto regions = damage(grid);
+	CHECK(regions.size() == 4);
+	CHECK(regions[0].row == 1 && regions[0].startCol == 1 && regions[0].endCol == 3);
+}
+
+static void scrollOutOfBounds() {
+	Grid grid = lettered(3, 5);
+
+	// clamped to the grid, or ignored when empty
+	grid.scroll(3, 10, 0, 10, 1);
+	CHECK(grid.glyph(3, 0) == 'e' && grid.glyph(4, 0) == 'e');
+	grid.scroll(4, 2, 0, 3, 1);
+	grid.scroll(0, 5, 0, 3, 10);
+	CHECK(grid.glyph(0, 0) == 'a');
+}
+
+static void fill() {
+	Grid grid = lettered(4, 2);
+
+	grid.fill(0, 2, 10, 'x', 7);
+	CHECK(grid.glyph(0, 1) == 'a' && grid.glyph(0, 3) == 'x' && grid.highlight(0, 3) == 7);
+	grid.fill(5, 0, 1, 'x', 0);
+	grid.fill(0, 4, 1, 'x', 0);
+
+	auto regions = damage(grid);
+	CHECK(regions.size() == 1);
+	CHECK(regions[0].row == 0 && regions[0].startCol == 2 && regions[0].endCol == 4);
+
+	grid.clear();
+	CHECK(grid.glyph(1, 0) == ' ' && damage(grid).size() == 2);
+}
+
+static void interning() {
+	nvimRpc::redraw::GlyphTable glyphs;
+	uint32_t accented = glyphs.intern("\xc3\xa9", 2);
+
+	CHECK(glyphs.intern("x", 1) == 'x');
+	CHECK(accented >= 128 && glyphs.intern("\xc3\xa9", 2) == accented);
+	CHECK(glyphs.text(accented) == "\xc3\xa9" && glyphs.text('x') == "x" && glyphs.text(0).empty());
+
+	nvimRpc::redraw::HighlightTable highlights;
+	nvimRpc::redraw::HighlightAttributes bold;
+	bold.flags = nvimRpc::redraw::BOLD;
+	highlights.define(5, bold);
+	highlights.define(9, bold);
+	CHECK(highlights.localId(5) == highlights.localId(9) && highlights.localId(5) != 0);
+	CHECK(highlights.localId(1000) == 0 && highlights.size() == 2);
+}
+
+// params of a redraw notification made of a single event
+template <typename... T> static msgpack::object_handle redraw(const std::string &name, const T &...args) {
+	msgpack::sbuffer buffer;
+	msgpack::packer<msgpack::sbuffer> pk(buffer);
+
+	pk.pack_array(1);
+	pk.pack_array(2);
+	pk << name;
+	pk.pack_array(sizeof...(args));
+	((pk << args), ...);
+	return msgpack::unpack(buffer.data(), buffer.size());
+}
+
+static void ui() {
+	nvimRpc::redraw::Ui ui;
+	bool flushed = false;
+
+	ui.onFlush([&flushed](nvimRpc::redraw::Ui &) { flushed = true; });
+	ui.handleRedraw(redraw("grid_resize", 1, 4, 2).get());
+	// one [text, highlight, repeat] cell covering two columns
+	std::vector<std::tuple<std::string, int, int>> repeated{{"x", 0, 2}};
+	ui.handleRedraw(redraw("grid_line", 1, 1, 0, repeated).get());
+	ui.handleRedraw(redraw("flush").get());
+	CHECK(flushed);
+	CHECK(ui.grid(1) != NULL && ui.grid(1)->width() == 4);
+	CHECK(ui.grid(1)->glyph(1, 0) == 'x' && ui.grid(1)->glyph(1, 1) == 'x' && ui.grid(1)->glyph(1, 2) == ' ');
+
+	bool rejected = false;
+	try {
+		ui.handleRedraw(redraw("grid_scroll", 1, 0, 2).get());
+	} catch (msgpack::type_error &) {
+		rejected = true;
+	}
+	CHECK(rejected);
+
+	rejected = false;
+	try {
+		std::vector<std::vector<int>> emptyCell{{}};
+		ui.handleRedraw(redraw("grid_line", 1, 0, 0, emptyCell).get());
+	} catch (msgpack::type_error &) {
+		rejected = true;
+	}
+	CHECK(rejected);
+}
+
+int main() {
+	scrollUp();
+	scrollDown();
+	scrollOutOfBounds();
+	fill();
+	interning();
+	ui();
+
+	return test::report("grid");
+}
@@ -0,0 +1,105 @@
+// packer::Buffer copied and referenced segments, and requests and responses
+// referencing their arguments or result matching msgpack's own packing
+#include <string>
+
+#include "common.hpp"
+#include "impl/MsgPacker.hpp"
+
+using nvimRpc::packer::Buffer;
+
+static std::string joined(const Buffer &buffer) {
+	std::string content;
+
+	buffer.forEachSegment([&content](const char *data, size_t size) { content.append(data, size); });
+	return content;
+}
+
+static size_t segmentCount(const Buffer &buffer) {
+	size_t count = 0;
+
+	buffer.forEachSegment([&count](const char *, size_t) { count++; });
+	return count;
+}
+
+static void copiedOnly() {
+	Buffer buffer;
+	std::string large(1000, 'x');
+
+	buffer.write("ab", 2);
+	buffer.write(large.data(), large.size());
+	CHECK(segmentCount(buffer) == 1);
+	CHECK(buffer.size() == 1002 && buffer.copiedSize() == 1002);
+	CHECK(std::string(buffer.data(), buffer.size()) == "ab" + large);
+}
+
+static void referenced() {
+	Buffer buffer(std::pmr::get_default_resource(), 4);
+	std::string large("abcdef");
+	const char *referencedData = NULL;
+
+	buffer.write("ab", 2);
+	buffer.write(large.data(), large.size());
+	buffer.write("cd", 2);
+	buffer.write("e", 1);
+	CHECK(segmentCount(buffer) == 3 && buffer.segmentCount() == 3);
+	CHECK(buffer.size() == 11 && buffer.copiedSize() == 5);
+	CHECK(joined(buffer) == "ababcdefcde");
+
+	size_t index = 0;
+	buffer.forEachSegment([&](const char *data, size_t) {
+		if (index++ == 1) {
+			referencedData = data;
+		}
+	});
+	CHECK(referencedData == large.data());
+
+	// consecutive references stay separate segments
+	Buffer references(std::pmr::get_default_resource(), 4);
+	references.write(large.data(), large.size());
+	references.write(large.data(), large.size());
+	CHECK(segmentCount(references) == 2 && references.copiedSize() == 0);
+}
+
+static void packedRequest() {
+	std::string large(2000, 'l');
+	std::vector<std::string> lines{"short", large, "short again"};
+	nvimRpc::packer::PackedRequest<int64_t, std::vector<std::string>> request(
+		"nvim_buf_set_lines", 7, std::pmr::get_default_resource(), 0, lines);
+
+	msgpack::sbuffer expected;
+	msgpack::packer<msgpack::sbuffer> pk(expected);
+	pk.pack_array(4) << (uint64_t)nvimRpc::packer::REQUEST << (uint64_t)7 << std::string("nvim_buf_set_lines");
+	pk.pack_array(2) << (int64_t)0 << lines;
+
+	CHECK(joined(request.buffer()) == std::string(expected.data(), expected.size()));
+	CHECK(request.size() == expected.size());
+	// only the long line is referenced
+	CHECK(request.buffer().copiedSize() == expected.size() - large.size());
+}
+
+static void packedResponse() {
+	Buffer result;
+	nvimRpc::packer::Packer resultPacker(result);
+	resultPacker << std::vector<int64_t>{1, 2, 3};
+
+	nvimRpc::packer::PackedResponse response(9, result);
+	msgpack::sbuffer expected;
+	msgpack::packer<msgpack::sbuffer> pk(expected);
+	pk.pack_array(4) << (uint64_t)nvimRpc::packer::RESPONSE << (uint64_t)9;
+	pk.pack_nil();
+	pk << std::vector<int64_t>{1, 2, 3};
+
+	CHECK(joined(response.buffer()) == std::string(expected.data(), expected.size()));
+	// the result is sent from where the handler packed it
+	CHECK(response.buffer().copiedSize() == expected.size() - result.size());
+	CHECK(segmentCount(response.buffer()) == 2);
+}
+
+int main() {
+	copiedOnly();
+	referenced();
+	packedRequest();
+	packedResponse();
+
+	return test::report("packerBuffer");
+}
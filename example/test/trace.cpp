@@ -0,0 +1,106 @@
+// trace::RingBuffer snapshots once the ring wrapped, and the Chrome trace
+// export of requests traced from several threads
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "common.hpp"
+#include "impl/Trace.hpp"
+
+using nvimRpc::trace::Event;
+using nvimRpc::trace::RingBuffer;
+
+static void pushEvents(RingBuffer &buffer, uint64_t count) {
+	for (uint64_t msgid = 0; msgid < count; msgid++) {
+		buffer.push(Event{msgid, msgid, 0, nvimRpc::trace::SENT, 0});
+	}
+}
+
+static void partialRing() {
+	auto buffer = std::make_unique<RingBuffer>(1);
+	std::vector<Event> events;
+
+	pushEvents(*buffer, 100);
+	buffer->snapshot(events);
+	CHECK(events.size() == 100);
+	CHECK(events.front().msgid == 0 && events.back().msgid == 99);
+}
+
+static void wrappedRing() {
+	auto buffer = std::make_unique<RingBuffer>(1);
+	std::vector<Event> events(3);
+
+	pushEvents(*buffer, RingBuffer::CAPACITY + 10);
+	buffer->snapshot(events);
+	// events 0 to 9 were overwritten, and the oldest remaining one shares its
+	// slot with the next event to be written so it is dropped as well
+	CHECK(events.size() == 3 + RingBuffer::CAPACITY - 1);
+	CHECK(events[3].msgid == 11);
+	CHECK(events.back().msgid == RingBuffer::CAPACITY + 9);
+
+	bool ordered = true;
+	for (size_t i = 4; i < events.size(); i++) {
+		ordered = ordered && events[i].msgid == events[i - 1].msgid + 1;
+	}
+	CHECK(ordered);
+}
+
+// number of "b" and "e" events per msgid in the exported JSON, one event per line
+static std::map<std::string, std::pair<int, int>> asyncSlices(const std::string &json) {
+	std::map<std::string, std::pair<int, int>> slices;
+	std::istringstream lines(json);
+	std::string line;
+
+	while (std::getline(lines, line)) {
+		size_t id = line.find("\"id\":\"");
+		if (id == std::string::npos) {
+			continue;
+		}
+		id += 6;
+		std::string msgid = line.substr(id, line.find('"', id) - id);
+		if (line.find("\"ph\":\"b\"") != std::string::npos) {
+			slices[msgid].first++;
+		} else if (line.find("\"ph\":\"e\"") != std::string::npos) {
+			slices[msgid].second++;
+		}
+	}
+	return slices;
+}
+
+static void exportedTrace() {
+	nvimRpc::trace::Tracer &tracer = nvimRpc::trace::Tracer::instance();
+	const std::string method("nvim_buf_get_lines");
+
+	tracer.enable(1);
+	for (uint64_t msgid = 0; msgid < 50; msgid++) {
+		nvimRpc::trace::record(msgid, nvimRpc::trace::PACKING);
+		nvimRpc::trace::recordPacked(msgid, method, 64);
+		// the response side of a request is traced from other threads
+		std::thread([msgid]() {
+			nvimRpc::trace::record(msgid, nvimRpc::trace::FRAME_READ);
+			nvimRpc::trace::record(msgid, nvimRpc::trace::FULFILLED);
+		}).join();
+	}
+	tracer.disable();
+
+	std::ostringstream out;
+	tracer.exportChromeTrace(out);
+	auto slices = asyncSlices(out.str());
+	bool paired = slices.size() == 50;
+	for (const auto &slice : slices) {
+		paired = paired && slice.second.first == 1 && slice.second.second == 1;
+	}
+	CHECK(paired);
+	CHECK(out.str().find("\"name\":\"nvim_buf_get_lines\"") != std::string::npos);
+	CHECK(out.str().find("\"otherData\"") != std::string::npos);
+}
+
+int main() {
+	partialRing();
+	wrappedRing();
+	exportedTrace();
+
+	return test::report("trace");
+}
@@ -0,0 +1,341 @@
+#ifndef BUFFER_DIFF
+#define BUFFER_DIFF
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "msgpack.hpp"
+
+namespace nvimRpc {
+namespace diff {
+using Lines = std::vector<std::string>;
+
+// Range of lines [currentStart, currentEnd) of the current content to replace
+// by the lines [desiredStart, desiredEnd) of the desired content
+struct Hunk {
+  size_t currentStart;
+  size_t currentEnd;
+  size_t desiredStart;
+  size_t desiredEnd;
+};
+
+// Change in the coordinates of the current content. Linewise edits replace
+// rows [startRow, endRow) (nvim_buf_set_lines), the others replace the text
+// from (startRow, startCol) to (endRow, endCol), columns being byte offsets
+// (nvim_buf_set_text).
+struct Edit {
+  bool linewise;
+  int64_t startRow;
+  int64_t startCol;
+  int64_t endRow;
+  int64_t endCol;
+  Lines replacement;
+};
+
+namespace impl {
+struct Snake {
+  size_t x;
+  size_t y;
+  size_t length;
+};
+
+class LineSequences {
+private:
+  const Lines &_current;
+  const Lines &_desired;
+  size_t _currentOffset;
+  size_t _desiredOffset;
+  std::vector<size_t> _currentHashes;
+  std::vector<size_t> _desiredHashes;
+
+public:
+  LineSequences(const Lines &current, size_t currentStart, size_t currentEnd, const Lines &desired,
+                size_t desiredStart, size_t desiredEnd)
+      : _current(current), _desired(desired), _currentOffset(currentStart), _desiredOffset(desiredStart) {
+    std::hash<std::string> hash;
+
+    _currentHashes.reserve(currentEnd - currentStart);
+    for (size_t i = currentStart; i < currentEnd; i++) {
+      _currentHashes.push_back(hash(current[i]));
+    }
+    _desiredHashes.reserve(desiredEnd - desiredStart);
+    for (size_t i = desiredStart; i < desiredEnd; i++) {
+      _desiredHashes.push_back(hash(desired[i]));
+    }
+  }
+
+  size_t currentSize() const { return _currentHashes.size(); }
+
+  size_t desiredSize() const { return _desiredHashes.size(); }
+
+  bool equal(size_t x, size_t y) const {
+    return _currentHashes[x] == _desiredHashes[y] && _current[_currentOffset + x] == _desired[_desiredOffset + y];
+  }
+};
+
+// Myers' O(ND) greedy algorithm, returns the common snakes in order. Gives up
+// and returns false when more than maxEditDistance insertions and deletions
+// are needed.
+inline bool myers(const LineSequences &sequences, size_t maxEditDistance, std::vector<Snake> &snakes) {
+  const long n = sequences.currentSize();
+  const long m = sequences.desiredSize();
+  const long limit = std::min<long>(n + m, maxEditDistance);
+  std::vector<long> v(2 * limit + 3, 0);
+  std::vector<std::vector<long>> trace;
+  long d = 0;
+  bool found = false;
+
+  auto at = [&v, limit](long k) -> long & { return v[k + limit + 1]; };
+
+  for (d = 0; d <= limit && !found; d++) {
+    for (long k = -d; k <= d; k += 2) {
+      long x = (k == -d || (k != d && at(k - 1) < at(k + 1))) ? at(k + 1) : at(k - 1) + 1;
+      long y = x - k;
+
+      while (x < n && y < m && sequences.equal(x, y)) {
+        x++;
+        y++;
+      }
+      at(k) = x;
+      if (x >= n && y >= m) {
+        found = true;
+        break;
+      }
+    }
+    // only the [-d, d] diagonals are needed to backtrack, keep memory in O(D^2)
+    trace.emplace_back(v.begin() + (limit + 1 - d), v.begin() + (limit + 2 + d));
+  }
+  if (!found) {
+    return false;
+  }
+
+  long x = n;
+  long y = m;
+  for (d = trace.size() - 1; d > 0; d--) {
+    const std::vector<long> &previous = trace[d - 1];
+    auto previousAt = [&previous, d](long k) { return previous[k + d - 1]; };
+    long k = x - y;
+    long previousK = (k == -d || (k != d && previousAt(k - 1) < previousAt(k + 1))) ? k + 1 : k - 1;
+    long previousX = previousAt(previousK);
+    long previousY = previousX - previousK;
+    long snakeX = previousK == k + 1 ? previousX : previousX + 1;
+
+    if (x > snakeX) {
+      snakes.push_back({static_cast<size_t>(snakeX), static_cast<size_t>(snakeX - k), static_cast<size_t>(x - snakeX)});
+    }
+    x = previousX;
+    y = previousY;
+  }
+  if (x > 0) {
+    snakes.push_back({0, 0, static_cast<size_t>(x)});
+  }
+  std::reverse(snakes.begin(), snakes.end());
+  return true;
+}
+
+inline std::string join(const Lines &lines, size_t start, size_t end) {
+  std::string joined;
+
+  for (size_t i = start; i < end; i++) {
+    if (i != start) {
+      joined += '\n';
+    }
+    joined += lines[i];
+  }
+  return joined;
+}
+
+inline bool isContinuationByte(char c) { return (static_cast<unsigned char>(c) & 0xC0) == 0x80; }
+
+// converts a byte offset of the joined lines starting at row into a (row, col) position
+inline void position(const std::string &joined, size_t offset, size_t row, int64_t &outRow, int64_t &outCol) {
+  size_t lineStart = 0;
+
+  for (size_t i = 0; i < offset; i++) {
+    if (joined[i] == '\n') {
+      row++;
+      lineStart = i + 1;
+    }
+  }
+  outRow = row;
+  outCol = offset - lineStart;
+}
+} // namespace impl
+
+// Hunks turning current into desired, in order. Common leading and trailing
+// lines are trimmed before diffing so small edits to large buffers stay cheap;
+// past maxEditDistance changed lines the middle is replaced as a whole.
+inline std::vector<Hunk> diffLines(const Lines &current, const Lines &desired, size_t maxEditDistance = 1024) {
+  std::vector<Hunk> hunks;
+  size_t prefix = 0;
+  size_t suffix = 0;
+
+  while (prefix < current.size() && prefix < desired.size() && current[prefix] == desired[prefix]) {
+    prefix++;
+  }
+  while (suffix < current.size() - prefix && suffix < desired.size() - prefix &&
+         current[current.size() - 1 - suffix] == desired[desired.size() - 1 - suffix]) {
+    suffix++;
+  }
+
+  size_t currentEnd = current.size() - suffix;
+  size_t desiredEnd = desired.size() - suffix;
+  if (prefix == currentEnd && prefix == desiredEnd) {
+    return hunks;
+  }
+
+  impl::LineSequences sequences(current, prefix, currentEnd, desired, prefix, desiredEnd);
+  std::vector<impl::Snake> snakes;
+  if (!impl::myers(sequences, maxEditDistance, snakes)) {
+    hunks.push_back({prefix, currentEnd, prefix, desiredEnd});
+    return hunks;
+  }
+
+  size_t x = 0;
+  size_t y = 0;
+  snakes.push_back({sequences.currentSize(), sequences.desiredSize(), 0});
+  for (const auto &snake : snakes) {
+    if (snake.x > x || snake.y > y) {
+      hunks.push_back({prefix + x, prefix + snake.x, prefix + y, prefix + snake.y});
+    }
+    x = snake.x + snake.length;
+    y = snake.y + snake.length;
+  }
+  return hunks;
+}
+
+// Edits applying the hunks, refined to the changed characters when lines are
+// replaced. They are ordered from the end of the buffer to its start so each
+// one can be applied without shifting the coordinates of the next.
+inline std::vector<Edit> computeEdits(const Lines &current, const Lines &desired, size_t maxEditDistance = 1024) {
+  std::vector<Edit> edits;
+  auto hunks = diffLines(current, desired, maxEditDistance);
+
+  for (auto hunk = hunks.rbegin(); hunk != hunks.rend(); hunk++) {
+    if (hunk->currentStart == hunk->currentEnd || hunk->desiredStart == hunk->desiredEnd) {
+      edits.push_back({true, static_cast<int64_t>(hunk->currentStart), 0, static_cast<int64_t>(hunk->currentEnd), 0,
+                       Lines(desired.begin() + hunk->desiredStart, desired.begin() + hunk->desiredEnd)});
+      continue;
+    }
+
+    std::string currentText = impl::join(current, hunk->currentStart, hunk->currentEnd);
+    std::string desiredText = impl::join(desired, hunk->desiredStart, hunk->desiredEnd);
+    size_t prefix = 0;
+    size_t suffix = 0;
+
+    while (prefix < currentText.size() && prefix < desiredText.size() && currentText[prefix] == desiredText[prefix]) {
+      prefix++;
+    }
+    while (suffix < currentText.size() - prefix && suffix < desiredText.size() - prefix &&
+           currentText[currentText.size() - 1 - suffix] == desiredText[desiredText.size() - 1 - suffix]) {
+      suffix++;
+    }
+    // never cut through a multibyte UTF-8 sequence
+    while (prefix > 0 && impl::isContinuationByte(currentText[prefix])) {
+      prefix--;
+    }
+    while (suffix > 0 && impl::isContinuationByte(currentText[currentText.size() - suffix])) {
+      suffix--;
+    }
+
+    Edit edit;
+    edit.linewise = false;
+    impl::position(currentText, prefix, hunk->currentStart, edit.startRow, edit.startCol);
+    impl::position(currentText, currentText.size() - suffix, hunk->currentStart, edit.endRow, edit.endCol);
+
+    std::string replacement = desiredText.substr(prefix, desiredText.size() - suffix - prefix);
+    size_t lineStart = 0;
+    for (size_t newline = replacement.find('\n'); newline != std::string::npos;
+         newline = replacement.find('\n', lineStart)) {
+      edit.replacement.push_back(replacement.substr(lineStart, newline - lineStart));
+      lineStart = newline + 1;
+    }
+    edit.replacement.push_back(replacement.substr(lineStart));
+    edits.push_back(std::move(edit));
+  }
+  return edits;
+}
+
+// nvim_exec_lua code failing when the buffer given as first argument is no
+// longer at the changedtick given as second argument
+constexpr const char *CHECK_CHANGEDTICK = "local buffer, changedtick = ...\n"
+                                          "if vim.api.nvim_buf_get_changedtick(buffer) ~= changedtick then\n"
+                                          "  error('nvimClient: buffer changed since it was read')\n"
+                                          "end\n";
+
+// nvim_exec_lua code returning {changedtick, lines} of the buffer given as
+// argument, read at once
+constexpr const char *GET_LINES_WITH_CHANGEDTICK = "local buffer = ...\n"
+                                                   "return {vim.api.nvim_buf_get_changedtick(buffer),\n"
+                                                   "        vim.api.nvim_buf_get_lines(buffer, 0, -1, true)}\n";
+
+// Packs as the calls argument of nvim_call_atomic. With a changedtick, the
+// edits are preceded by a CHECK_CHANGEDTICK call so nvim stops before
+// applying any of them if the buffer changed in the meantime.
+struct BufferEdits {
+  int64_t buffer;
+  std::vector<Edit> edits;
+  int64_t changedtick = -1;
+
+  template <typename Packer> void msgpack_pack(Packer &pk) const {
+    pk.pack_array(edits.size() + (changedtick >= 0 ? 1 : 0));
+    if (changedtick >= 0) {
+      pk.pack_array(2);
+      pk << std::string("nvim_exec_lua");
+      pk.pack_array(2);
+      pk << std::string(CHECK_CHANGEDTICK);
+      pk.pack_array(2);
+      pk << buffer << changedtick;
+    }
+    for (const auto &edit : edits) {
+      pk.pack_array(2);
+      if (edit.linewise) {
+        pk << std::string("nvim_buf_set_lines");
+        pk.pack_array(5);
+        pk << buffer << edit.startRow << edit.endRow << true << edit.replacement;
+      } else {
+        pk << std::string("nvim_buf_set_text");
+        pk.pack_array(6);
+        pk << buffer << edit.startRow << edit.startCol << edit.endRow << edit.endCol << edit.replacement;
+      }
+    }
+  }
+};
+
+// Results of the edits from the [results, error] response of nvim_call_atomic
+// to BufferEdits, guarded telling whether it had a changedtick. Throws a
+// std::runtime_error when nvim stopped at a failing call.
+inline std::vector<msgpack::type::variant> editResults(const msgpack::object &response, bool guarded) {
+  if (response.type != msgpack::type::ARRAY || response.via.array.size != 2) {
+    throw std::runtime_error("malformed nvim_call_atomic response");
+  }
+
+  const msgpack::object &error = response.via.array.ptr[1];
+  if (error.type != msgpack::type::NIL) {
+    // [index of the failing call, error type, message]
+    if (error.type != msgpack::type::ARRAY || error.via.array.size < 3) {
+      throw std::runtime_error("nvim_call_atomic failed");
+    }
+    int64_t index = error.via.array.ptr[0].as<int64_t>();
+    std::string message = error.via.array.ptr[2].as<std::string>();
+
+    if (guarded && index == 0) {
+      throw std::runtime_error("buffer changed since it was read: " + message);
+    }
+    throw std::runtime_error("edit " + std::to_string(index - (guarded ? 1 : 0)) + " failed: " + message);
+  }
+
+  auto results = response.via.array.ptr[0].as<std::vector<msgpack::type::variant>>();
+  if (guarded && !results.empty()) {
+    results.erase(results.begin());
+  }
+  return results;
+}
+} // namespace diff
+} // namespace nvimRpc
+
+#endif /* !BUFFER_DIFF */
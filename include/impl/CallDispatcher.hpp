@@ -1,83 +1,199 @@
 #ifndef CALL_DISPATCHER
 #define CALL_DISPATCHER
 
+#include <array>
 #include <cstddef>
 #include <exception>
+#include <functional>
 #include <future>
 #include <iostream>
+#include <atomic>
+#include <map>
 #include <memory>
+#include <memory_resource>
 #include <mutex>
 #include <string>
 #include <thread>
 #include <tuple>
+#include <type_traits>
+#include <vector>
 
 #include "impl/MsgPacker.hpp"
 #include "impl/TcpConnector.hpp"
+#include "impl/Trace.hpp"
+#include "impl/WorkerPool.hpp"
 
 namespace dispatcher {
 enum CallState { PENDING, DONE };
 
+// containers opting in to polymorphic allocators (std::pmr::vector,
+// std::pmr::string...) are decoded into memory from resource
+template <class T> T makeValue(std::pmr::memory_resource *resource) {
+  // std::tuple uses any allocator but is not constructible from one alone
+  if constexpr (std::uses_allocator_v<T, std::pmr::polymorphic_allocator<char>> &&
+                std::is_constructible_v<T, std::pmr::polymorphic_allocator<char>>) {
+    return T(std::pmr::polymorphic_allocator<char>(resource));
+  } else {
+    return T();
+  }
+}
+
+// Throws a std::runtime_error holding nvim's message if the request failed
+template <class T>
+T decodeResponse(const nvimRpc::packer::PackedRequestResponse &packedResponse, std::pmr::memory_resource *resource) {
+  T value = makeValue<T>(resource);
+  nvimRpc::packer::Error error;
+
+  if (packedResponse.error(error)) {
+    throw std::runtime_error(std::get<1>(error));
+  }
+  // when decoding to Void, packedResponse.value() returns false and leaves
+  // value to its default
+  packedResponse.value(value);
+  return value;
+}
+
 class CallInterface {
 public:
+  virtual ~CallInterface() = default;
   virtual void fulfillPromise(const nvimRpc::packer::PackedRequestResponse &packedResponse) = 0;
   virtual CallState state() = 0;
+  // calls are allocated from a memory resource, destroy() gives the memory back to it
+  virtual void destroy() = 0;
 };
 
 template <class T, class... U> class Call : public CallInterface {
 private:
   CallState _state;
-  const char *_data;
-  size_t _dataSize;
+  uint64_t _id;
+  std::pmr::memory_resource *_resource;
   std::promise<T> _promise;
 
 public:
-  Call<T, U...>(const std::shared_ptr<nvimRpc::packer::PackedRequest<U...>> &request) {
+  Call<T, U...>(const std::shared_ptr<nvimRpc::packer::PackedRequest<U...>> &request)
+      : _resource(request->resource()),
+        _promise(std::allocator_arg, std::pmr::polymorphic_allocator<char>(request->resource())) {
     _state = PENDING;
-    _data = request->data();
-    _dataSize = request->size();
+    _id = request->id();
   }
 
-  CallState state() { return _state; }
+  static Call<T, U...> *create(const std::shared_ptr<nvimRpc::packer::PackedRequest<U...>> &request) {
+    std::pmr::polymorphic_allocator<Call<T, U...>> allocator(request->resource());
+    Call<T, U...> *call = allocator.allocate(1);
+
+    new (call) Call<T, U...>(request);
+    return call;
+  }
+
+  void destroy() {
+    std::pmr::polymorphic_allocator<Call<T, U...>> allocator(_resource);
 
-  const char *data() { return _data; }
+    this->~Call<T, U...>();
+    allocator.deallocate(this, 1);
+  }
 
-  size_t size() { return _dataSize; }
+  CallState state() { return _state; }
 
   std::future<T> getFuture() { return _promise.get_future(); }
 
   void fulfillPromise(const nvimRpc::packer::PackedRequestResponse &packedResponse) {
-    T value;
-    nvimRpc::packer::Error error;
+    try {
+      T value = decodeResponse<T>(packedResponse, _resource);
+
+      nvimRpc::trace::record(_id, nvimRpc::trace::DECODED);
+      _promise.set_value(std::move(value));
+    } catch (std::exception &) {
+      _promise.set_exception(std::current_exception());
+    }
+    nvimRpc::trace::record(_id, nvimRpc::trace::FULFILLED);
+
+    _state = DONE;
+  }
+};
+
+using ResponseHandler = std::function<void(const nvimRpc::packer::PackedRequestResponse &)>;
+
+// Hands the undecoded response to a handler on the worker receiving it rather
+// than fulfilling a promise, for callers chaining more work on the response
+class CallbackCall : public CallInterface {
+private:
+  CallState _state;
+  uint64_t _id;
+  std::pmr::memory_resource *_resource;
+  ResponseHandler _handler;
+
+public:
+  CallbackCall(uint64_t id, std::pmr::memory_resource *resource, ResponseHandler handler)
+      : _state(PENDING), _id(id), _resource(resource), _handler(std::move(handler)) {}
+
+  static CallbackCall *create(uint64_t id, std::pmr::memory_resource *resource, ResponseHandler handler) {
+    std::pmr::polymorphic_allocator<CallbackCall> allocator(resource);
+    CallbackCall *call = allocator.allocate(1);
+
+    new (call) CallbackCall(id, resource, std::move(handler));
+    return call;
+  }
+
+  void destroy() {
+    std::pmr::polymorphic_allocator<CallbackCall> allocator(_resource);
+
+    this->~CallbackCall();
+    allocator.deallocate(this, 1);
+  }
+
+  CallState state() { return _state; }
 
-    if (packedResponse.error(error)) {
-      _promise.set_exception(std::make_exception_ptr(std::runtime_error(std::get<1>(error))));
-    } else if (packedResponse.value(value)) {
-      _promise.set_value(value);
-    } else {
-      // this is for when fulfilling a promise to Void, packedResponse.value()
-      // returns false
-      _promise.set_value(T());
+  void fulfillPromise(const nvimRpc::packer::PackedRequestResponse &packedResponse) {
+    try {
+      _handler(packedResponse);
+    } catch (std::exception &e) {
+      std::cerr << "response handler failed: " << e.what() << std::endl;
     }
+    nvimRpc::trace::record(_id, nvimRpc::trace::FULFILLED);
 
     _state = DONE;
   }
 };
 
+using NotificationHandler = std::function<void(const nvimRpc::packer::PackedRequestResponse &)>;
+// Packs at most one object, the result, into the packer; packing nothing
+// answers nil. Throwing answers the request with the exception's message as
+// error, as does packing several objects.
+using RequestHandler = std::function<void(const nvimRpc::packer::PackedRequestResponse &, nvimRpc::packer::Packer &)>;
+
 class CallDispatcher {
 private:
+  static constexpr size_t READ_SIZE = 64 * 1024;
+  static constexpr size_t INLINE_SEGMENTS = 8;
+
   std::mutex *_callMap_mtx;
   std::mutex *_connector_mtx;
+  std::mutex *_handlers_mtx;
+  // held by whoever reads from the connector: the listening thread, or a
+  // synchronous caller reading its own response (leader/follower)
+  std::mutex *_reader_mtx;
+  std::atomic<bool> _syncReader;
   const Tcp::Connector *_connector;
   std::map<int, CallInterface *> _callMap;
+  std::map<std::string, NotificationHandler> _notificationHandlers;
+  std::map<std::string, RequestHandler> _requestHandlers;
+  std::pmr::memory_resource *_resource;
+  msgpack::unpacker _unpacker;
+  size_t _workerCount;
+  WorkerPool *_workerPool;
+  WorkerPool *_requestPool;
+  Strand *_notificationStrand;
   std::thread *_thread;
 
-  std::vector<char> _readFromSocket() {
+  bool _readFromSocket() {
     std::lock_guard lockConnector(*_connector_mtx);
 
     if (!_connector->available()) {
-      return std::vector<char>();
+      return false;
     }
-    return _connector->read();
+    _unpacker.reserve_buffer(READ_SIZE);
+    _unpacker.buffer_consumed(_connector->read(_unpacker.buffer(), _unpacker.buffer_capacity()));
+    return true;
   }
 
   bool _isConnectorConnected() {
@@ -86,64 +202,344 @@ private:
     return _connector->isConnected();
   }
 
-  void _unpackReceivedMessage(const std::vector<char> &receivedMessage) {
-    size_t offset = 0;
+  void _dispatch(const nvimRpc::packer::PackedRequestResponse &packedResponse) {
+    switch (packedResponse.type()) {
+    case nvimRpc::packer::MessageType::RESPONSE:
+      nvimRpc::trace::record(packedResponse.id(), nvimRpc::trace::FRAME_READ);
+      _fulfillPlacedCall(packedResponse);
+      break;
+    case nvimRpc::packer::MessageType::NOTIFY:
+      _notify(packedResponse);
+      break;
+    case nvimRpc::packer::MessageType::REQUEST:
+      _serve(packedResponse);
+      break;
+    }
+  }
 
-    while (offset != receivedMessage.size()) {
-      auto packedResponse = nvimRpc::packer::PackedRequestResponse(receivedMessage, offset);
-
-      switch (packedResponse.type()) {
-      case nvimRpc::packer::MessageType::RESPONSE:
-        _fulfillPlacedCall(packedResponse);
-        break;
-      case nvimRpc::packer::MessageType::NOTIFY:
-        // figure out what to do with notifications
-        throw std::runtime_error("Notifications handling has not been "
-                                 "implemented yet because I'm a lazy fuck");
-      }
+  // Only frames complete in the unpacker buffer are handed over, a response
+  // larger than a single read is simply completed by the following reads.
+  void _unpackReceivedMessages() {
+    msgpack::object_handle objectHandle;
+
+    while (_unpacker.next(objectHandle)) {
+      _dispatchFrame(std::move(objectHandle));
     }
   }
 
-  void _fulfillPlacedCall(const nvimRpc::packer::PackedRequestResponse &packedResponse) {
+  // [type, id, ...] header of a request or response frame, read without
+  // converting anything that could throw
+  static bool _frameHeader(const msgpack::object &frame, uint64_t &type, uint64_t &id) {
+    if (frame.type != msgpack::type::ARRAY || frame.via.array.size < 3 ||
+        frame.via.array.ptr[0].type != msgpack::type::POSITIVE_INTEGER ||
+        frame.via.array.ptr[1].type != msgpack::type::POSITIVE_INTEGER) {
+      return false;
+    }
+    type = frame.via.array.ptr[0].via.u64;
+    id = frame.via.array.ptr[1].via.u64;
+    return true;
+  }
+
+  // A frame that can't be parsed or dispatched (malformed, unknown response
+  // id...) is logged and dropped instead of taking the reading thread down.
+  // Requests that can still be identified are answered with the error.
+  void _dispatchFrame(msgpack::object_handle &&objectHandle) {
+    uint64_t type;
+    uint64_t id;
+    bool isRequest = _frameHeader(objectHandle.get(), type, id) && type == nvimRpc::packer::MessageType::REQUEST;
+    std::string error;
+
+    try {
+      _dispatch(nvimRpc::packer::PackedRequestResponse(std::move(objectHandle), _resource));
+      return;
+    } catch (std::exception &e) {
+      error = e.what();
+    } catch (...) {
+      error = "unknown exception";
+    }
+    std::cerr << "dropped received message: " << error << std::endl;
+    if (!isRequest) {
+      return;
+    }
+    try {
+      _send(nvimRpc::packer::PackedResponse(id, std::string("malformed request: ") + error, _resource));
+    } catch (std::exception &e) {
+      std::cerr << "could not answer dropped request: " << e.what() << std::endl;
+    }
+  }
+
+  CallInterface *_takePlacedCall(uint64_t id) {
     std::lock_guard lockCallMap(*_callMap_mtx);
 
-    auto call = _callMap[packedResponse.id()];
-    if (call->state() == DONE) {
-      throw std::runtime_error(std::string("request with id ") + std::to_string(packedResponse.id()) +
-                               std::string(" already fulfilled"));
+    auto placedCall = _callMap.find(id);
+    if (placedCall == _callMap.end()) {
+      throw std::runtime_error(std::string("request with id ") + std::to_string(id) +
+                               std::string(" already fulfilled or never placed"));
     }
 
-    call->fulfillPromise(packedResponse);
-    // remove call from map?
+    auto call = placedCall->second;
+    _callMap.erase(placedCall);
+    return call;
+  }
+
+  // Typed conversion of the response and promise completion happen on the
+  // worker pool, so a huge response does not delay the small ones behind it.
+  void _fulfillPlacedCall(const nvimRpc::packer::PackedRequestResponse &packedResponse) {
+    auto call = _takePlacedCall(packedResponse.id());
+
+    _workerPool->post([call, packedResponse]() {
+      call->fulfillPromise(packedResponse);
+      call->destroy();
+    });
+  }
+
+  // Notifications all go through the same strand to be handled in the order
+  // nvim sent them.
+  void _notify(const nvimRpc::packer::PackedRequestResponse &packedNotification) {
+    NotificationHandler handler;
+    {
+      std::lock_guard lockHandlers(*_handlers_mtx);
+
+      auto registeredHandler = _notificationHandlers.find(packedNotification.method());
+      if (registeredHandler == _notificationHandlers.end()) {
+        return;
+      }
+      handler = registeredHandler->second;
+    }
+
+    _notificationStrand->post([handler, packedNotification]() { handler(packedNotification); });
+  }
+
+  // Requests run on their own pool, a long handler never delays the responses
+  // to our own calls.
+  void _serve(const nvimRpc::packer::PackedRequestResponse &packedRequest) {
+    RequestHandler handler;
+    {
+      std::lock_guard lockHandlers(*_handlers_mtx);
+
+      auto registeredHandler = _requestHandlers.find(packedRequest.method());
+      if (registeredHandler == _requestHandlers.end()) {
+        _send(nvimRpc::packer::PackedResponse(packedRequest.id(),
+                                              std::string("no handler for method ") + packedRequest.method(),
+                                              _resource));
+        return;
+      }
+      handler = registeredHandler->second;
+    }
+
+    _requestPool->post([this, handler, packedRequest]() {
+      nvimRpc::packer::Buffer result(_resource);
+      nvimRpc::packer::Packer resultPacker(result);
+
+      try {
+        handler(packedRequest, resultPacker);
+        // a handler packing nothing answers nil
+        if (result.size() == 0) {
+          resultPacker.pack_nil();
+        } else if (!_holdsOneObject(result)) {
+          throw std::runtime_error(std::string("handler for method ") + packedRequest.method() +
+                                   " must pack exactly one result");
+        }
+      } catch (std::exception &e) {
+        _send(nvimRpc::packer::PackedResponse(packedRequest.id(), std::string(e.what()), _resource));
+        return;
+      } catch (...) {
+        _send(nvimRpc::packer::PackedResponse(packedRequest.id(),
+                                              std::string("handler for method ") + packedRequest.method() + " failed",
+                                              _resource));
+        return;
+      }
+      _send(nvimRpc::packer::PackedResponse(packedRequest.id(), result, _resource));
+    });
+  }
+
+  // Walks the result without building any zone nor object. Result buffers
+  // never reference, their data() is contiguous.
+  static bool _holdsOneObject(const nvimRpc::packer::Buffer &result) {
+    msgpack::v2::null_visitor visitor;
+    size_t offset = 0;
+
+    return msgpack::v2::parse(result.data(), result.size(), offset, visitor) && offset == result.size();
+  }
+
+  void _send(const nvimRpc::packer::PackedResponse &packedResponse) {
+    std::lock_guard lockConnector(*_connector_mtx);
+
+    _sendBuffer(packedResponse.buffer());
+  }
+
+  // caller holds the call map and connector locks. A call whose request could
+  // not be sent is forgotten and destroyed before rethrowing.
+  void _placeAndSend(uint64_t id, CallInterface *call, const nvimRpc::packer::Buffer &buffer) {
+    _callMap[id] = call;
+    try {
+      _sendBuffer(buffer);
+    } catch (...) {
+      _callMap.erase(id);
+      call->destroy();
+      throw;
+    }
+  }
+
+  // caller holds the connector lock. Most messages have a few segments, their
+  // buffer sequence then stays on the stack (unused entries are empty);
+  // longer ones get it from the buffer's resource.
+  void _sendBuffer(const nvimRpc::packer::Buffer &buffer) {
+    if (buffer.segmentCount() <= INLINE_SEGMENTS) {
+      std::array<boost::asio::const_buffer, INLINE_SEGMENTS> buffers;
+      size_t count = 0;
+
+      buffer.forEachSegment(
+          [&buffers, &count](const char *data, size_t size) { buffers[count++] = boost::asio::const_buffer(data, size); });
+      _connector->send(buffers);
+      return;
+    }
+
+    std::pmr::vector<boost::asio::const_buffer> buffers(buffer.resource());
+    buffers.reserve(buffer.segmentCount());
+    buffer.forEachSegment([&buffers](const char *data, size_t size) { buffers.emplace_back(data, size); });
+    _connector->send(buffers);
   }
 
 public:
-  CallDispatcher(const Tcp::Connector *connector) : _connector(connector) {
+  // resource is used for the bookkeeping of received messages, outgoing calls
+  // use the resource of the request they were packed with. Both are used from
+  // several workers at once and must be thread safe.
+  CallDispatcher(const Tcp::Connector *connector, size_t workerCount = std::thread::hardware_concurrency(),
+                 std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : _connector(connector), _resource(resource), _workerCount(workerCount) {
     _callMap = std::map<int, CallInterface *>();
     _callMap_mtx = new std::mutex();
     _connector_mtx = new std::mutex();
+    _handlers_mtx = new std::mutex();
+    _reader_mtx = new std::mutex();
+    _syncReader = false;
+    _workerPool = new WorkerPool(workerCount);
+    _requestPool = NULL;
+    _notificationStrand = new Strand(_workerPool);
     _thread = NULL;
   }
 
+  ~CallDispatcher() {
+    delete _requestPool;
+    delete _workerPool;
+    delete _notificationStrand;
+    delete _callMap_mtx;
+    delete _connector_mtx;
+    delete _handlers_mtx;
+    delete _reader_mtx;
+  }
+
   template <typename T, typename... U>
   std::future<T> placeCall(const std::shared_ptr<nvimRpc::packer::PackedRequest<U...>> request) {
+    nvimRpc::trace::record(request->id(), nvimRpc::trace::ENQUEUED);
     std::lock_guard lockCallMap(*_callMap_mtx);
     std::lock_guard lockConnector(*_connector_mtx);
-    Call<T, U...> *callToPlace = new Call<T, U...>(request);
-    _callMap[request->id()] = callToPlace;
-    _connector->send(callToPlace->data(), callToPlace->size());
+    nvimRpc::trace::record(request->id(), nvimRpc::trace::LOCKED);
+    Call<T, U...> *callToPlace = Call<T, U...>::create(request);
+    _placeAndSend(request->id(), callToPlace, request->buffer());
+    nvimRpc::trace::record(request->id(), nvimRpc::trace::SENT);
 
     return callToPlace->getFuture();
   }
 
+  // Same as placeCall, the response is handed to handler on a worker
+  template <typename... U>
+  void placeCallback(const std::shared_ptr<nvimRpc::packer::PackedRequest<U...>> request, ResponseHandler handler) {
+    nvimRpc::trace::record(request->id(), nvimRpc::trace::ENQUEUED);
+    std::lock_guard lockCallMap(*_callMap_mtx);
+    std::lock_guard lockConnector(*_connector_mtx);
+    nvimRpc::trace::record(request->id(), nvimRpc::trace::LOCKED);
+    CallbackCall *callToPlace = CallbackCall::create(request->id(), request->resource(), std::move(handler));
+    _placeAndSend(request->id(), callToPlace, request->buffer());
+    nvimRpc::trace::record(request->id(), nvimRpc::trace::SENT);
+  }
+
+  // When no other call is in flight, the calling thread takes over reading
+  // from the connector and decodes its own response in place, with no
+  // promise nor handoff to another thread. Other messages read meanwhile are
+  // dispatched as usual. Falls back to placeCall().get() otherwise.
+  template <typename T, typename... U>
+  T placeCallSync(const std::shared_ptr<nvimRpc::packer::PackedRequest<U...>> request) {
+    bool expected = false;
+    {
+      std::lock_guard lockCallMap(*_callMap_mtx);
+
+      if (!_callMap.empty() || !_syncReader.compare_exchange_strong(expected, true)) {
+        expected = true;
+      }
+    }
+    if (expected) {
+      T value = placeCall<T, U...>(request).get();
+
+      nvimRpc::trace::record(request->id(), nvimRpc::trace::CONSUMED);
+      return value;
+    }
+
+    nvimRpc::trace::record(request->id(), nvimRpc::trace::ENQUEUED);
+    std::lock_guard lockReader(*_reader_mtx);
+    _syncReader = false;
+    {
+      std::lock_guard lockConnector(*_connector_mtx);
+      nvimRpc::trace::record(request->id(), nvimRpc::trace::LOCKED);
+      _sendBuffer(request->buffer());
+      nvimRpc::trace::record(request->id(), nvimRpc::trace::SENT);
+    }
+
+    msgpack::object_handle objectHandle;
+    while (true) {
+      while (!_unpacker.next(objectHandle)) {
+        if (!_isConnectorConnected()) {
+          throw std::runtime_error("connector disconnected while waiting for a response");
+        }
+        _readFromSocket();
+      }
+
+      uint64_t type;
+      uint64_t id;
+      if (!_frameHeader(objectHandle.get(), type, id) || type != nvimRpc::packer::MessageType::RESPONSE ||
+          id != request->id()) {
+        _dispatchFrame(std::move(objectHandle));
+        continue;
+      }
+
+      nvimRpc::packer::PackedRequestResponse packedResponse(std::move(objectHandle), _resource);
+      nvimRpc::trace::record(request->id(), nvimRpc::trace::FRAME_READ);
+      T value = decodeResponse<T>(packedResponse, request->resource());
+
+      nvimRpc::trace::record(request->id(), nvimRpc::trace::DECODED);
+      nvimRpc::trace::record(request->id(), nvimRpc::trace::CONSUMED);
+      return value;
+    }
+  }
+
+  void onNotification(const std::string &method, NotificationHandler handler) {
+    std::lock_guard lockHandlers(*_handlers_mtx);
+
+    _notificationHandlers[method] = handler;
+  }
+
+  // the pool serving requests is only started along with the first handler
+  void onRequest(const std::string &method, RequestHandler handler) {
+    std::lock_guard lockHandlers(*_handlers_mtx);
+
+    if (_requestPool == NULL) {
+      _requestPool = new WorkerPool(_workerCount);
+    }
+    _requestHandlers[method] = handler;
+  }
+
   void listenToConnector() {
-    nvimRpc::packer::MessageIdentifier messageIdentifier;
     while (_isConnectorConnected()) {
-      auto readFromSocket = _readFromSocket();
-
-      if (readFromSocket.size() > 0) {
-        _unpackReceivedMessage(readFromSocket);
+      // let a synchronous caller become the reader
+      if (_syncReader) {
+        std::this_thread::yield();
+        continue;
       }
+
+      std::lock_guard lockReader(*_reader_mtx);
+      _readFromSocket();
+      _unpackReceivedMessages();
     }
   }
 
@@ -0,0 +1,40 @@
+#ifndef MEMORY_RESOURCE
+#define MEMORY_RESOURCE
+
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+
+namespace nvimRpc {
+namespace memory {
+// Serializes every use of upstream. Resources given to the client are
+// allocated from by the dispatcher's workers concurrently, this is how a
+// resource that is not thread safe (e.g. a std::pmr::monotonic_buffer_resource
+// arena per batch of calls) can be used.
+class SynchronizedResource : public std::pmr::memory_resource {
+private:
+  std::pmr::memory_resource *_upstream;
+  std::mutex _mtx;
+
+protected:
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    std::lock_guard lockUpstream(_mtx);
+
+    return _upstream->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+    std::lock_guard lockUpstream(_mtx);
+
+    _upstream->deallocate(p, bytes, alignment);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+public:
+  SynchronizedResource(std::pmr::memory_resource *upstream) : _upstream(upstream) {}
+};
+} // namespace memory
+} // namespace nvimRpc
+
+#endif /* !MEMORY_RESOURCE */
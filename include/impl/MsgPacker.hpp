@@ -5,12 +5,83 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "msgpack.hpp"
 
 namespace nvimRpc {
 namespace packer {
-using Packer = msgpack::packer<msgpack::sbuffer>;
+// msgpack stream writing into memory obtained from a std::pmr::memory_resource,
+// stands in for msgpack::sbuffer which can only use malloc.
+// Given a referenceThreshold, writes of at least that many bytes (string and
+// binary bodies) are not copied but referenced in place, like
+// msgpack::vrefbuffer does: the packed message is then a list of segments
+// (forEachSegment) and the referenced memory must outlive the buffer's use.
+class Buffer {
+private:
+  struct Segment {
+    const char *reference;
+    size_t offset;
+    size_t size;
+  };
+
+  std::pmr::vector<char> _data;
+  std::pmr::vector<Segment> _segments;
+  size_t _referenceThreshold;
+  size_t _size;
+
+public:
+  Buffer(std::pmr::memory_resource *resource = std::pmr::get_default_resource(), size_t referenceThreshold = 0)
+      : _data(resource), _segments(resource), _referenceThreshold(referenceThreshold), _size(0) {}
+
+  void write(const char *buf, size_t len) {
+    if (_referenceThreshold != 0 && len >= _referenceThreshold) {
+      _segments.push_back({buf, 0, len});
+    } else {
+      if (_segments.empty() || _segments.back().reference != NULL) {
+        _segments.push_back({NULL, _data.size(), 0});
+      }
+      _data.insert(_data.end(), buf, buf + len);
+      _segments.back().size += len;
+    }
+    _size += len;
+  }
+
+  // appends other's content by reference, other must not change and must
+  // outlive this buffer's use
+  void reference(const Buffer &other) {
+    other.forEachSegment([this](const char *data, size_t size) {
+      _segments.push_back({data, 0, size});
+      _size += size;
+    });
+  }
+
+  void reserve(size_t size) { _data.reserve(size); }
+
+  // contiguous content, only valid when nothing was referenced
+  const char *data() const { return _data.data(); }
+
+  size_t size() const { return _size; }
+
+  size_t segmentCount() const { return _segments.size(); }
+
+  std::pmr::memory_resource *resource() const { return _data.get_allocator().resource(); }
+
+  // bytes copied into the buffer, the other size() - copiedSize() are referenced
+  size_t copiedSize() const { return _data.size(); }
+
+  template <typename F> void forEachSegment(F callback) const {
+    for (const auto &segment : _segments) {
+      callback(segment.reference != NULL ? segment.reference : _data.data() + segment.offset, segment.size);
+    }
+  }
+};
+
+using Packer = msgpack::packer<Buffer>;
 using Object = msgpack::object;
 using Void = msgpack::type::nil_t;
 using Error = msgpack::type::tuple<uint64_t, std::string>;
@@ -30,55 +101,133 @@ template <typename... T> Packer &pack(Packer &pk, const T &...args) {
 
 Packer &pack(Packer &pack) { return pack; }
 
+// Tag constructing a PackedRequest that copies all of its arguments, for a
+// request that may be sent again once they are gone
+struct CopiedArguments {};
+
+// Arguments' string and binary bodies of REFERENCE_THRESHOLD bytes or more are
+// referenced rather than copied, they must stay valid until the request is
+// sent. The dispatcher sends it before placeCall returns. Shorter bodies, such
+// as the lines of most buffers, are still copied: a segment per line would cost
+// more in gathered write entries than the copy saves.
 template <typename... T> class PackedRequest {
 private:
-  msgpack::sbuffer _buffer;
-  Packer *_packer;
+  static constexpr size_t INITIAL_BUFFER_SIZE = 256;
+  static constexpr size_t REFERENCE_THRESHOLD = 512;
+
+  std::pmr::memory_resource *_resource;
+  Buffer _buffer;
+  Packer _packer;
   uint64_t _id;
 
-public:
-  PackedRequest(const std::string &method, uint64_t msgid, const T &...args) : _id(msgid) {
-    _buffer = msgpack::sbuffer();
-    _packer = new Packer(&_buffer);
+  void _pack(const std::string &method, const T &...args) {
+    _buffer.reserve(INITIAL_BUFFER_SIZE);
+
+    _packer.pack_array(4) << (uint64_t)REQUEST << _id << method;
 
-    _packer->pack_array(4) << (uint64_t)REQUEST << msgid << method;
+    _packer.pack_array(sizeof...(args));
 
-    _packer->pack_array(sizeof...(args));
+    pack(_packer, args...);
+  }
 
-    pack(*_packer, args...);
+public:
+  PackedRequest(const std::string &method, uint64_t msgid, std::pmr::memory_resource *resource, const T &...args)
+      : _resource(resource), _buffer(resource, REFERENCE_THRESHOLD), _packer(_buffer), _id(msgid) {
+    _pack(method, args...);
   };
 
-  ~PackedRequest() { free(_packer); };
+  PackedRequest(CopiedArguments, const std::string &method, uint64_t msgid, std::pmr::memory_resource *resource,
+                const T &...args)
+      : _resource(resource), _buffer(resource), _packer(_buffer), _id(msgid) {
+    _pack(method, args...);
+  };
 
-  const char *data() const { return _buffer.data(); };
+  const Buffer &buffer() const { return _buffer; }
 
-  const Packer *getPacker() const { return _packer; }
+  const Packer *getPacker() const { return &_packer; }
 
   size_t size() const { return _buffer.size(); };
 
   uint64_t id() const { return _id; }
+
+  std::pmr::memory_resource *resource() const { return _resource; }
+};
+
+// Response to a request received from nvim, result holds exactly one packed
+// object. Only the header is packed, result is referenced and must outlive the
+// response.
+class PackedResponse {
+private:
+  Buffer _buffer;
+  Packer _packer;
+
+public:
+  PackedResponse(uint64_t msgid, const Buffer &result,
+                 std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : _buffer(resource), _packer(_buffer) {
+    _packer.pack_array(4) << (uint64_t)RESPONSE << msgid;
+    _packer.pack_nil();
+    _buffer.reference(result);
+  }
+
+  PackedResponse(uint64_t msgid, const std::string &errorMessage,
+                 std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : _buffer(resource), _packer(_buffer) {
+    _packer.pack_array(4) << (uint64_t)RESPONSE << msgid << Error(0, errorMessage);
+    _packer.pack_nil();
+  }
+
+  const Buffer &buffer() const { return _buffer; }
+
+  size_t size() const { return _buffer.size(); };
 };
 
 class PackedRequestResponse {
 private:
-  std::vector<char> _rawResponse;
+  std::shared_ptr<msgpack::zone> _zone;
   uint64_t _msgType;
   uint64_t _msgId;
+  std::string _method;
   Object _objectValue;
   Object _objectError;
 
 public:
   PackedRequestResponse(){};
-  PackedRequestResponse(const std::vector<char> &rawResponse, size_t &offset) {
-    _rawResponse = std::vector<char>(rawResponse);
-
-    msgpack::object_handle objectHandle = msgpack::unpack(_rawResponse.data(), _rawResponse.size(), offset);
-    msgpack::type::tuple<uint64_t, uint64_t, Object, Object> unpackedResponse;
-    objectHandle.get().convert(unpackedResponse);
-    _msgType = unpackedResponse.get<0>();
-    _msgId = unpackedResponse.get<1>();
-    _objectValue = unpackedResponse.get<3>();
-    _objectError = unpackedResponse.get<2>();
+  PackedRequestResponse(msgpack::object_handle &&objectHandle,
+                        std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : _msgId(0) {
+    const Object &message = objectHandle.get();
+
+    if (message.type != msgpack::type::ARRAY || message.via.array.size < 3) {
+      throw std::runtime_error("received malformed msgpack-rpc message");
+    }
+    _msgType = message.via.array.ptr[0].as<uint64_t>();
+    switch (_msgType) {
+    case REQUEST:
+      if (message.via.array.size != 4) {
+        throw std::runtime_error("received malformed msgpack-rpc request");
+      }
+      _msgId = message.via.array.ptr[1].as<uint64_t>();
+      _method = message.via.array.ptr[2].as<std::string>();
+      _objectValue = message.via.array.ptr[3];
+      break;
+    case RESPONSE:
+      if (message.via.array.size != 4) {
+        throw std::runtime_error("received malformed msgpack-rpc response");
+      }
+      _msgId = message.via.array.ptr[1].as<uint64_t>();
+      _objectError = message.via.array.ptr[2];
+      _objectValue = message.via.array.ptr[3];
+      break;
+    case NOTIFY:
+      _method = message.via.array.ptr[1].as<std::string>();
+      _objectValue = message.via.array.ptr[2];
+      break;
+    }
+    // the objects above point into the zone, keep it alive for as long as the
+    // response is, including while it waits in a worker queue
+    _zone = std::shared_ptr<msgpack::zone>(objectHandle.zone().release(), std::default_delete<msgpack::zone>(),
+                                           std::pmr::polymorphic_allocator<msgpack::zone>(resource));
   };
 
   template <class T> bool value(T &value) const { return _objectValue.convert_if_not_nil(value); }
@@ -88,6 +237,13 @@ public:
   uint64_t type() const { return _msgType; }
 
   uint64_t id() const { return _msgId; }
+
+  const std::string &method() const { return _method; }
+
+  const Object &params() const { return _objectValue; }
+
+  // undecoded result of a response, valid for as long as the response is
+  const Object &result() const { return _objectValue; }
 };
 } // namespace packer
 } // namespace nvimRpc
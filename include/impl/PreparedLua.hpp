@@ -0,0 +1,68 @@
+#ifndef PREPARED_LUA
+#define PREPARED_LUA
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace nvimRpc {
+namespace lua {
+constexpr const char *UNPREPARED_ERROR = "nvimClient: unprepared chunk";
+
+// nvim_exec_lua code invoking a chunk already registered under the key
+// given as first argument, with the remaining arguments
+constexpr const char *CALL_PREPARED = "local prepared = _G.__nvimClientPrepared or {}\n"
+                                      "local f = prepared[...]\n"
+                                      "if not f then error('nvimClient: unprepared chunk') end\n"
+                                      "return f(select(2, ...))\n";
+
+// nvim_exec_lua code registering the chunk given as (key, code) then invoking
+// it with the remaining arguments
+constexpr const char *PREPARE_AND_CALL = "local key, code = ...\n"
+                                         "_G.__nvimClientPrepared = _G.__nvimClientPrepared or {}\n"
+                                         "local f = assert((loadstring or load)(code))\n"
+                                         "_G.__nvimClientPrepared[key] = f\n"
+                                         "return f(select(3, ...))\n";
+
+// nvim_exec_lua code registering the chunk given as (key, code)
+constexpr const char *PREPARE = "local key, code = ...\n"
+                                "_G.__nvimClientPrepared = _G.__nvimClientPrepared or {}\n"
+                                "_G.__nvimClientPrepared[key] = assert((loadstring or load)(code))\n";
+
+// FNV-1a, only used to key chunks in nvim's table
+inline std::string contentHash(const std::string &code) {
+  uint64_t hash = 14695981039346656037ULL;
+  char hex[17];
+
+  for (unsigned char c : code) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+  return std::string(hex);
+}
+
+inline bool isUnprepared(const std::exception &error) {
+  return std::string(error.what()).find(UNPREPARED_ERROR) != std::string::npos;
+}
+
+// Lua chunk called through Client::callPrepared, its code only goes on the
+// wire the first time it is used on a connection
+class PreparedChunk {
+private:
+  std::string _key;
+  std::shared_ptr<const std::string> _code;
+
+public:
+  PreparedChunk(const std::string &code) : _key(contentHash(code)), _code(std::make_shared<const std::string>(code)) {}
+
+  const std::string &key() const { return _key; }
+
+  const std::string &code() const { return *_code; }
+};
+} // namespace lua
+} // namespace nvimRpc
+
+#endif /* !PREPARED_LUA */
@@ -0,0 +1,441 @@
+#ifndef REDRAW
+#define REDRAW
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "impl/MsgPacker.hpp"
+
+namespace nvimRpc {
+namespace redraw {
+enum HighlightFlags {
+  BOLD = 1 << 0,
+  ITALIC = 1 << 1,
+  UNDERLINE = 1 << 2,
+  UNDERCURL = 1 << 3,
+  STRIKETHROUGH = 1 << 4,
+  REVERSE = 1 << 5,
+};
+
+struct HighlightAttributes {
+  int64_t foreground = -1;
+  int64_t background = -1;
+  int64_t special = -1;
+  uint32_t flags = 0;
+
+  bool operator<(const HighlightAttributes &other) const {
+    return std::tie(foreground, background, special, flags) <
+           std::tie(other.foreground, other.background, other.special, other.flags);
+  }
+};
+
+// Maps nvim's highlight ids to local ones, attributes defined identically
+// under several nvim ids share the same local id. Local id 0 is the default
+// highlight.
+class HighlightTable {
+private:
+  std::vector<uint32_t> _localIds;
+  std::vector<HighlightAttributes> _attributes;
+  std::map<HighlightAttributes, uint32_t> _interned;
+
+public:
+  HighlightTable() { clear(); }
+
+  void clear() {
+    _localIds.assign(1, 0);
+    _attributes.assign(1, HighlightAttributes());
+    _interned.clear();
+    _interned[HighlightAttributes()] = 0;
+  }
+
+  void define(uint64_t nvimId, const HighlightAttributes &attributes) {
+    auto interned = _interned.find(attributes);
+    uint32_t localId;
+
+    if (interned == _interned.end()) {
+      localId = _attributes.size();
+      _attributes.push_back(attributes);
+      _interned[attributes] = localId;
+    } else {
+      localId = interned->second;
+    }
+    if (nvimId >= _localIds.size()) {
+      _localIds.resize(nvimId + 1, 0);
+    }
+    _localIds[nvimId] = localId;
+  }
+
+  uint32_t localId(uint64_t nvimId) const { return nvimId < _localIds.size() ? _localIds[nvimId] : 0; }
+
+  const HighlightAttributes &attributes(uint32_t localId) const { return _attributes[localId]; }
+
+  size_t size() const { return _attributes.size(); }
+};
+
+// Cell texts are stored as glyph ids: ASCII characters are their own id, any
+// other text (multibyte characters, combining sequences) is interned once.
+class GlyphTable {
+private:
+  static constexpr uint32_t FIRST_INTERNED = 128;
+
+  char _ascii[FIRST_INTERNED];
+  std::vector<std::string> _texts;
+  std::unordered_map<std::string, uint32_t> _ids;
+
+public:
+  GlyphTable() {
+    for (uint32_t i = 0; i < FIRST_INTERNED; i++) {
+      _ascii[i] = static_cast<char>(i);
+    }
+  }
+
+  uint32_t intern(const char *text, size_t size) {
+    if (size == 0) {
+      return 0;
+    }
+    if (size == 1 && static_cast<unsigned char>(text[0]) < FIRST_INTERNED) {
+      return static_cast<unsigned char>(text[0]);
+    }
+
+    std::string key(text, size);
+    auto interned = _ids.find(key);
+    if (interned != _ids.end()) {
+      return interned->second;
+    }
+    uint32_t id = FIRST_INTERNED + _texts.size();
+    _ids.emplace(key, id);
+    _texts.push_back(std::move(key));
+    return id;
+  }
+
+  std::string_view text(uint32_t id) const {
+    if (id == 0) {
+      return std::string_view();
+    }
+    if (id < FIRST_INTERNED) {
+      return std::string_view(_ascii + id, 1);
+    }
+    return _texts[id - FIRST_INTERNED];
+  }
+};
+
+// Columns [startCol, endCol) of row changed since the damage was last cleared
+struct DamagedRegion {
+  size_t row;
+  size_t startCol;
+  size_t endCol;
+};
+
+// Struct of arrays grid, row major: glyphs()[row * width() + col] and
+// highlights()[row * width() + col] describe the same cell. Storage is only
+// (re)allocated on resize.
+class Grid {
+private:
+  size_t _width;
+  size_t _height;
+  std::vector<uint32_t> _glyphs;
+  std::vector<uint32_t> _highlights;
+  std::vector<size_t> _damageStart;
+  std::vector<size_t> _damageEnd;
+
+  void _damage(size_t row, size_t startCol, size_t endCol) {
+    _damageStart[row] = std::min(_damageStart[row], startCol);
+    _damageEnd[row] = std::max(_damageEnd[row], endCol);
+  }
+
+  void _moveRow(size_t from, size_t to, size_t left, size_t right) {
+    std::copy(_glyphs.begin() + from * _width + left, _glyphs.begin() + from * _width + right,
+              _glyphs.begin() + to * _width + left);
+    std::copy(_highlights.begin() + from * _width + left, _highlights.begin() + from * _width + right,
+              _highlights.begin() + to * _width + left);
+    _damage(to, left, right);
+  }
+
+public:
+  Grid() : _width(0), _height(0) {}
+
+  void resize(size_t width, size_t height) {
+    _width = width;
+    _height = height;
+    _glyphs.assign(width * height, ' ');
+    _highlights.assign(width * height, 0);
+    _damageStart.assign(height, 0);
+    _damageEnd.assign(height, width);
+  }
+
+  void clear() {
+    std::fill(_glyphs.begin(), _glyphs.end(), ' ');
+    std::fill(_highlights.begin(), _highlights.end(), 0);
+    std::fill(_damageStart.begin(), _damageStart.end(), 0);
+    std::fill(_damageEnd.begin(), _damageEnd.end(), _width);
+  }
+
+  void fill(size_t row, size_t col, size_t count, uint32_t glyph, uint32_t highlight) {
+    if (row >= _height || col >= _width) {
+      return;
+    }
+    count = std::min(count, _width - col);
+    std::fill_n(_glyphs.begin() + row * _width + col, count, glyph);
+    std::fill_n(_highlights.begin() + row * _width + col, count, highlight);
+    _damage(row, col, col + count);
+  }
+
+  // grid_scroll semantics: rows > 0 moves the region [top, bottom) x [left, right)
+  // up by rows, rows < 0 moves it down. Rows left behind keep their content
+  // until nvim redraws them.
+  void scroll(size_t top, size_t bottom, size_t left, size_t right, int64_t rows) {
+    bottom = std::min(bottom, _height);
+    right = std::min(right, _width);
+    if (top >= bottom || left >= right) {
+      return;
+    }
+    if (rows > 0) {
+      size_t distance = rows;
+      for (size_t row = top; row + distance < bottom; row++) {
+        _moveRow(row + distance, row, left, right);
+      }
+    } else if (rows < 0) {
+      size_t distance = -rows;
+      for (size_t row = bottom; row-- > top + distance;) {
+        _moveRow(row - distance, row, left, right);
+      }
+    }
+  }
+
+  size_t width() const { return _width; }
+
+  size_t height() const { return _height; }
+
+  const std::vector<uint32_t> &glyphs() const { return _glyphs; }
+
+  const std::vector<uint32_t> &highlights() const { return _highlights; }
+
+  uint32_t glyph(size_t row, size_t col) const { return _glyphs[row * _width + col]; }
+
+  uint32_t highlight(size_t row, size_t col) const { return _highlights[row * _width + col]; }
+
+  template <typename F> void forEachDamagedRegion(F callback) const {
+    for (size_t row = 0; row < _height; row++) {
+      if (_damageStart[row] < _damageEnd[row]) {
+        callback(DamagedRegion{row, _damageStart[row], _damageEnd[row]});
+      }
+    }
+  }
+
+  void clearDamage() {
+    std::fill(_damageStart.begin(), _damageStart.end(), _width);
+    std::fill(_damageEnd.begin(), _damageEnd.end(), 0);
+  }
+};
+
+struct Cursor {
+  int64_t grid = 0;
+  size_t row = 0;
+  size_t col = 0;
+};
+
+// Model of a ui attached with ext_linegrid. Redraw notifications are decoded
+// straight from the received msgpack objects, without intermediate
+// containers. Everything is guarded by mutex(); the flush callback is run
+// with it held, at the end of each of nvim's redraw batches.
+class Ui {
+private:
+  std::mutex _mtx;
+  std::map<int64_t, Grid> _grids;
+  HighlightTable _highlights;
+  GlyphTable _glyphs;
+  HighlightAttributes _defaultColors;
+  Cursor _cursor;
+  std::function<void(Ui &)> _onFlush;
+
+  static int64_t _integer(const packer::Object &object) {
+    switch (object.type) {
+    case msgpack::type::POSITIVE_INTEGER:
+      return object.via.u64;
+    case msgpack::type::NEGATIVE_INTEGER:
+      return object.via.i64;
+    default:
+      throw msgpack::type_error();
+    }
+  }
+
+  static std::string_view _string(const packer::Object &object) {
+    if (object.type != msgpack::type::STR) {
+      throw msgpack::type_error();
+    }
+    return std::string_view(object.via.str.ptr, object.via.str.size);
+  }
+
+  static const msgpack::object_array &_array(const packer::Object &object) {
+    if (object.type != msgpack::type::ARRAY) {
+      throw msgpack::type_error();
+    }
+    return object.via.array;
+  }
+
+  // args of an event must hold at least count values, later nvim versions may
+  // append more
+  static void _expectArity(const msgpack::object_array &args, uint32_t count) {
+    if (args.size < count) {
+      throw msgpack::type_error();
+    }
+  }
+
+  static HighlightAttributes _attributes(const packer::Object &rgbAttributes) {
+    HighlightAttributes attributes;
+
+    if (rgbAttributes.type != msgpack::type::MAP) {
+      return attributes;
+    }
+    for (uint32_t i = 0; i < rgbAttributes.via.map.size; i++) {
+      const auto &entry = rgbAttributes.via.map.ptr[i];
+      auto key = _string(entry.key);
+
+      if (key == "foreground") {
+        attributes.foreground = _integer(entry.val);
+      } else if (key == "background") {
+        attributes.background = _integer(entry.val);
+      } else if (key == "special") {
+        attributes.special = _integer(entry.val);
+      } else if (entry.val.type == msgpack::type::BOOLEAN && entry.val.via.boolean) {
+        if (key == "bold") {
+          attributes.flags |= BOLD;
+        } else if (key == "italic") {
+          attributes.flags |= ITALIC;
+        } else if (key == "underline") {
+          attributes.flags |= UNDERLINE;
+        } else if (key == "undercurl") {
+          attributes.flags |= UNDERCURL;
+        } else if (key == "strikethrough") {
+          attributes.flags |= STRIKETHROUGH;
+        } else if (key == "reverse") {
+          attributes.flags |= REVERSE;
+        }
+      }
+    }
+    return attributes;
+  }
+
+  void _gridLine(const msgpack::object_array &args) {
+    _expectArity(args, 4);
+    Grid &grid = _grids[_integer(args.ptr[0])];
+    size_t row = _integer(args.ptr[1]);
+    size_t col = _integer(args.ptr[2]);
+    const msgpack::object_array &cells = _array(args.ptr[3]);
+    uint32_t highlight = 0;
+
+    for (uint32_t i = 0; i < cells.size; i++) {
+      const msgpack::object_array &cell = _array(cells.ptr[i]);
+      _expectArity(cell, 1);
+      auto text = _string(cell.ptr[0]);
+      size_t repeat = 1;
+
+      // the highlight id is omitted when it is the same as the previous cell's
+      if (cell.size > 1) {
+        highlight = _highlights.localId(_integer(cell.ptr[1]));
+      }
+      if (cell.size > 2) {
+        repeat = _integer(cell.ptr[2]);
+      }
+      grid.fill(row, col, repeat, _glyphs.intern(text.data(), text.size()), highlight);
+      col += repeat;
+    }
+  }
+
+  void _event(std::string_view name, const msgpack::object_array &args) {
+    if (name == "grid_line") {
+      _gridLine(args);
+    } else if (name == "grid_scroll") {
+      _expectArity(args, 6);
+      _grids[_integer(args.ptr[0])].scroll(_integer(args.ptr[1]), _integer(args.ptr[2]), _integer(args.ptr[3]),
+                                           _integer(args.ptr[4]), _integer(args.ptr[5]));
+    } else if (name == "grid_resize") {
+      _expectArity(args, 3);
+      _grids[_integer(args.ptr[0])].resize(_integer(args.ptr[1]), _integer(args.ptr[2]));
+    } else if (name == "grid_clear") {
+      _expectArity(args, 1);
+      _grids[_integer(args.ptr[0])].clear();
+    } else if (name == "grid_destroy") {
+      _expectArity(args, 1);
+      _grids.erase(_integer(args.ptr[0]));
+    } else if (name == "grid_cursor_goto") {
+      _expectArity(args, 3);
+      _cursor = Cursor{_integer(args.ptr[0]), static_cast<size_t>(_integer(args.ptr[1])),
+                       static_cast<size_t>(_integer(args.ptr[2]))};
+    } else if (name == "hl_attr_define") {
+      _expectArity(args, 2);
+      _highlights.define(_integer(args.ptr[0]), _attributes(args.ptr[1]));
+    } else if (name == "default_colors_set") {
+      _expectArity(args, 3);
+      _defaultColors.foreground = _integer(args.ptr[0]);
+      _defaultColors.background = _integer(args.ptr[1]);
+      _defaultColors.special = _integer(args.ptr[2]);
+    } else if (name == "flush") {
+      if (_onFlush) {
+        _onFlush(*this);
+      }
+    }
+  }
+
+public:
+  // params of a redraw notification: [[name, args...], [name, args...], ...],
+  // each event carrying one args array per call batched under it. Throws
+  // msgpack::type_error on a malformed event, the ones before it are applied.
+  void handleRedraw(const packer::Object &params) {
+    std::lock_guard lockUi(_mtx);
+
+    const msgpack::object_array &events = _array(params);
+
+    for (uint32_t event = 0; event < events.size; event++) {
+      const msgpack::object_array &batch = _array(events.ptr[event]);
+
+      if (batch.size == 0) {
+        continue;
+      }
+      auto name = _string(batch.ptr[0]);
+      for (uint32_t i = 1; i < batch.size; i++) {
+        _event(name, _array(batch.ptr[i]));
+      }
+    }
+  }
+
+  void onFlush(std::function<void(Ui &)> callback) {
+    std::lock_guard lockUi(_mtx);
+
+    _onFlush = callback;
+  }
+
+  std::mutex &mutex() { return _mtx; }
+
+  const Grid *grid(int64_t id) const {
+    auto grid = _grids.find(id);
+
+    return grid == _grids.end() ? NULL : &grid->second;
+  }
+
+  Grid *grid(int64_t id) {
+    auto grid = _grids.find(id);
+
+    return grid == _grids.end() ? NULL : &grid->second;
+  }
+
+  const HighlightTable &highlights() const { return _highlights; }
+
+  const GlyphTable &glyphs() const { return _glyphs; }
+
+  const HighlightAttributes &defaultColors() const { return _defaultColors; }
+
+  const Cursor &cursor() const { return _cursor; }
+};
+} // namespace redraw
+} // namespace nvimRpc
+
+#endif /* !REDRAW */
@@ -39,17 +39,29 @@ public:
       throw std::runtime_error("Attempting to write to disconnected socket");
     }
 
-    _socket->write_some(boost::asio::buffer(buff, size), error);
+    boost::asio::write(*_socket, boost::asio::buffer(buff, size), error);
+    if (error) {
+      throw boost::system::system_error(error);
+    }
   };
 
-  std::vector<char> read() const {
-    std::array<char, 4096> buf;
+  // gathered write of a sequence of boost::asio::const_buffer, sent as they are
+  // without copying them together
+  template <typename ConstBufferSequence> void send(const ConstBufferSequence &buffers) const {
+    boost::system::error_code error;
 
-    size_t sizeRead = _socket->read_some(boost::asio::buffer(buf));
+    if (!_isConnected) {
+      throw std::runtime_error("Attempting to write to disconnected socket");
+    }
 
-    return std::vector<char>(buf.begin(), buf.begin() + sizeRead);
+    boost::asio::write(*_socket, buffers, error);
+    if (error) {
+      throw boost::system::system_error(error);
+    }
   };
 
+  size_t read(char *buff, size_t size) const { return _socket->read_some(boost::asio::buffer(buff, size)); };
+
   void connect() {
     boost::asio::socket_base::keep_alive option(true);
 
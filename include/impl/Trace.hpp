@@ -0,0 +1,253 @@
+#ifndef TRACE
+#define TRACE
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nvimRpc {
+namespace trace {
+// Lifecycle of a request, in order
+enum Phase {
+  PACKING,    // _packRequest entered
+  PACKED,     // request packed, carries the method and payload size
+  ENQUEUED,   // placeCall entered
+  LOCKED,     // call map and connector locks acquired
+  SENT,       // request written to the connector
+  FRAME_READ, // response frame read from the connector
+  DECODED,    // response converted to the result type
+  FULFILLED,  // promise fulfilled
+  CONSUMED,   // result handed back to a synchronous caller
+};
+
+constexpr const char *PHASE_NAMES[] = {"packing",    "packed",  "enqueued",  "locked",  "sent",
+                                       "frame read", "decoded", "fulfilled", "consumed"};
+
+struct Event {
+  uint64_t timestamp;
+  uint64_t msgid;
+  uint64_t size;
+  uint32_t phase;
+  uint32_t methodId;
+};
+
+// Written by its owning thread only, without locks. Once full the oldest
+// events are overwritten.
+class RingBuffer {
+public:
+  static constexpr size_t CAPACITY = 1 << 14;
+
+private:
+  std::array<Event, CAPACITY> _events;
+  std::atomic<uint64_t> _written;
+  uint32_t _threadId;
+
+public:
+  RingBuffer(uint32_t threadId) : _written(0), _threadId(threadId) {}
+
+  void push(const Event &event) {
+    uint64_t written = _written.load(std::memory_order_relaxed);
+
+    _events[written % CAPACITY] = event;
+    _written.store(written + 1, std::memory_order_release);
+  }
+
+  // events possibly overwritten while being copied are dropped
+  void snapshot(std::vector<Event> &events) const {
+    uint64_t written = _written.load(std::memory_order_acquire);
+    uint64_t first = written > CAPACITY ? written - CAPACITY : 0;
+    size_t start = events.size();
+
+    for (uint64_t i = first; i < written; i++) {
+      events.push_back(_events[i % CAPACITY]);
+    }
+
+    // the copies above must not be reordered after the reload, as in a seqlock
+    // reader. The writer may be storing event writtenAfter, over event
+    // writtenAfter - CAPACITY.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t writtenAfter = _written.load(std::memory_order_relaxed);
+    if (writtenAfter >= CAPACITY && writtenAfter - CAPACITY + 1 > first) {
+      size_t overwritten = std::min<uint64_t>(writtenAfter - CAPACITY + 1 - first, written - first);
+      events.erase(events.begin() + start, events.begin() + start + overwritten);
+    }
+  }
+
+  uint32_t threadId() const { return _threadId; }
+};
+
+class Tracer {
+private:
+  std::atomic<uint32_t> _sampleEvery;
+  std::mutex _mtx;
+  std::vector<std::shared_ptr<RingBuffer>> _buffers;
+  std::map<std::string, uint32_t> _methodIds;
+  std::vector<std::string> _methods;
+
+  Tracer() : _sampleEvery(0) {}
+
+  RingBuffer &_threadBuffer() {
+    thread_local std::shared_ptr<RingBuffer> buffer;
+
+    if (!buffer) {
+      std::lock_guard lockTracer(_mtx);
+
+      buffer = std::make_shared<RingBuffer>(_buffers.size() + 1);
+      _buffers.push_back(buffer);
+    }
+    return *buffer;
+  }
+
+  // ids are cached per thread, the tracer's lock is only taken the first time
+  // a thread packs a given method
+  uint32_t _methodId(const std::string &method) {
+    thread_local std::unordered_map<std::string, uint32_t> cachedIds;
+
+    auto cachedId = cachedIds.find(method);
+    if (cachedId != cachedIds.end()) {
+      return cachedId->second;
+    }
+
+    std::lock_guard lockTracer(_mtx);
+    auto methodId = _methodIds.find(method);
+    if (methodId == _methodIds.end()) {
+      _methods.push_back(method);
+      methodId = _methodIds.emplace(method, _methods.size() - 1).first;
+    }
+    cachedIds.emplace(method, methodId->second);
+    return methodId->second;
+  }
+
+  static uint64_t _now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  static void _writeEscaped(std::ostream &out, const std::string &text) {
+    for (char c : text) {
+      if (c == '"' || c == '\\') {
+        out << '\\';
+      }
+      out << (static_cast<unsigned char>(c) < 0x20 ? ' ' : c);
+    }
+  }
+
+public:
+  static Tracer &instance() {
+    static Tracer tracer;
+
+    return tracer;
+  }
+
+  // traces one request out of sampleEvery, 0 disables tracing
+  void enable(uint32_t sampleEvery = 1) { _sampleEvery.store(sampleEvery, std::memory_order_relaxed); }
+
+  void disable() { enable(0); }
+
+  bool sampled(uint64_t msgid) const {
+    uint32_t sampleEvery = _sampleEvery.load(std::memory_order_relaxed);
+
+    return sampleEvery != 0 && msgid % sampleEvery == 0;
+  }
+
+  void record(uint64_t msgid, Phase phase, uint64_t size = 0) {
+    if (sampled(msgid)) {
+      _threadBuffer().push(Event{_now(), msgid, size, static_cast<uint32_t>(phase), 0});
+    }
+  }
+
+  void recordPacked(uint64_t msgid, const std::string &method, uint64_t size) {
+    if (sampled(msgid)) {
+      _threadBuffer().push(Event{_now(), msgid, size, PACKED, _methodId(method)});
+    }
+  }
+
+  // Chrome trace / Perfetto JSON: one async slice per request, named after
+  // its method, with an instant per lifecycle phase on the thread it
+  // happened on. Futures are consumed out of the client's sight, so requests
+  // placed with call() end at "fulfilled"; only _sync calls are "consumed".
+  void exportChromeTrace(std::ostream &out) {
+    std::vector<std::pair<uint32_t, Event>> events;
+    std::vector<std::string> methods;
+    {
+      std::lock_guard lockTracer(_mtx);
+      std::vector<Event> bufferEvents;
+
+      for (const auto &buffer : _buffers) {
+        bufferEvents.clear();
+        buffer->snapshot(bufferEvents);
+        for (const auto &event : bufferEvents) {
+          events.emplace_back(buffer->threadId(), event);
+        }
+      }
+      methods = _methods;
+    }
+    std::sort(events.begin(), events.end(), [](const auto &a, const auto &b) {
+      return a.second.msgid < b.second.msgid ||
+             (a.second.msgid == b.second.msgid && a.second.timestamp < b.second.timestamp);
+    });
+
+    bool first = true;
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << "{\"otherData\":{\"consumed\":\"only recorded for _sync calls, the consumption of futures is not "
+           "observed\"},\"traceEvents\":[";
+    for (size_t start = 0; start < events.size();) {
+      size_t end = start;
+      std::string method = "request";
+      uint64_t size = 0;
+
+      while (end < events.size() && events[end].second.msgid == events[start].second.msgid) {
+        if (events[end].second.phase == PACKED) {
+          method = methods[events[end].second.methodId];
+          size = events[end].second.size;
+        }
+        end++;
+      }
+      for (size_t i = start; i < end; i++) {
+        const Event &event = events[i].second;
+        auto emit = [&](const char *ph, const std::string &name) {
+          out << (first ? "" : ",") << "\n{\"ph\":\"" << ph << "\",\"cat\":\"nvimRpc\",\"name\":\"";
+          _writeEscaped(out, name);
+          out << "\",\"id\":\"" << event.msgid << "\",\"pid\":1,\"tid\":" << events[i].first
+              << ",\"ts\":" << std::fixed << std::setprecision(3) << event.timestamp / 1000.0
+              << ",\"args\":{\"msgid\":" << event.msgid << ",\"size\":" << (event.size ? event.size : size) << "}}";
+          first = false;
+        };
+
+        if (i == start) {
+          emit("b", method);
+        }
+        emit("n", PHASE_NAMES[event.phase]);
+        if (i == end - 1) {
+          emit("e", method);
+        }
+      }
+      start = end;
+    }
+    out << "\n]}\n";
+    out.flags(flags);
+    out.precision(precision);
+  }
+};
+
+inline void record(uint64_t msgid, Phase phase, uint64_t size = 0) { Tracer::instance().record(msgid, phase, size); }
+
+inline void recordPacked(uint64_t msgid, const std::string &method, uint64_t size) {
+  Tracer::instance().recordPacked(msgid, method, size);
+}
+} // namespace trace
+} // namespace nvimRpc
+
+#endif /* !TRACE */
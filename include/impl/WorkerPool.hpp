@@ -0,0 +1,180 @@
+#ifndef WORKER_POOL
+#define WORKER_POOL
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dispatcher {
+using Task = std::function<void()>;
+
+// Fixed size pool of workers, each owning its own queue. Idle workers steal
+// from the back of their neighbours' queues so that one long task (e.g. the
+// conversion of a huge response) never holds back the tasks queued behind it.
+class WorkerPool {
+private:
+  struct WorkQueue {
+    std::mutex mtx;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<WorkQueue *> _queues;
+  std::vector<std::thread> _threads;
+  std::atomic<size_t> _nextQueue;
+  std::atomic<size_t> _queuedTasks;
+  std::mutex _idle_mtx;
+  std::condition_variable _idle_cv;
+  bool _stopping;
+
+  bool _popOwn(size_t index, Task &task) {
+    std::lock_guard lockQueue(_queues[index]->mtx);
+
+    if (_queues[index]->tasks.empty()) {
+      return false;
+    }
+    task = std::move(_queues[index]->tasks.front());
+    _queues[index]->tasks.pop_front();
+    return true;
+  }
+
+  bool _steal(size_t thief, Task &task) {
+    for (size_t i = 1; i < _queues.size(); i++) {
+      WorkQueue *victim = _queues[(thief + i) % _queues.size()];
+      std::lock_guard lockQueue(victim->mtx);
+
+      if (!victim->tasks.empty()) {
+        task = std::move(victim->tasks.back());
+        victim->tasks.pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void _work(size_t index) {
+    Task task;
+
+    while (true) {
+      if (_popOwn(index, task) || _steal(index, task)) {
+        _queuedTasks--;
+        try {
+          task();
+        } catch (std::exception &e) {
+          std::cerr << "worker task failed: " << e.what() << std::endl;
+        } catch (...) {
+          std::cerr << "worker task failed: unknown exception" << std::endl;
+        }
+        continue;
+      }
+
+      std::unique_lock lockIdle(_idle_mtx);
+      _idle_cv.wait(lockIdle, [this]() { return _stopping || _queuedTasks > 0; });
+      if (_stopping && _queuedTasks == 0) {
+        return;
+      }
+    }
+  }
+
+public:
+  WorkerPool(size_t workerCount) : _nextQueue(0), _queuedTasks(0), _stopping(false) {
+    workerCount = std::max<size_t>(workerCount, 1);
+    for (size_t i = 0; i < workerCount; i++) {
+      _queues.push_back(new WorkQueue());
+    }
+    for (size_t i = 0; i < workerCount; i++) {
+      _threads.emplace_back(&WorkerPool::_work, this, i);
+    }
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard lockIdle(_idle_mtx);
+      _stopping = true;
+    }
+    _idle_cv.notify_all();
+    for (auto &thread : _threads) {
+      thread.join();
+    }
+    for (auto queue : _queues) {
+      delete queue;
+    }
+  }
+
+  void post(Task task) {
+    WorkQueue *queue = _queues[_nextQueue++ % _queues.size()];
+
+    // counted before being published, a worker popping it right away must
+    // never bring the count below zero
+    {
+      std::lock_guard lockIdle(_idle_mtx);
+      _queuedTasks++;
+    }
+    {
+      std::lock_guard lockQueue(queue->mtx);
+      queue->tasks.push_back(std::move(task));
+    }
+    _idle_cv.notify_one();
+  }
+
+  size_t size() const { return _threads.size(); }
+};
+
+// Runs the tasks posted to it one at a time, in posting order, on top of a
+// WorkerPool. Used wherever ordering matters (e.g. notifications).
+class Strand {
+private:
+  WorkerPool *_pool;
+  std::mutex _mtx;
+  std::deque<Task> _tasks;
+  bool _running;
+
+  void _drain() {
+    while (true) {
+      Task task;
+      {
+        std::lock_guard lockTasks(_mtx);
+
+        if (_tasks.empty()) {
+          _running = false;
+          return;
+        }
+        task = std::move(_tasks.front());
+        _tasks.pop_front();
+      }
+      try {
+        task();
+      } catch (std::exception &e) {
+        std::cerr << "strand task failed: " << e.what() << std::endl;
+      } catch (...) {
+        std::cerr << "strand task failed: unknown exception" << std::endl;
+      }
+    }
+  }
+
+public:
+  Strand(WorkerPool *pool) : _pool(pool), _running(false) {}
+
+  void post(Task task) {
+    bool schedule;
+    {
+      std::lock_guard lockTasks(_mtx);
+
+      _tasks.push_back(std::move(task));
+      schedule = !_running;
+      _running = true;
+    }
+    if (schedule) {
+      _pool->post([this]() { _drain(); });
+    }
+  }
+};
+} // namespace dispatcher
+
+#endif /* !WORKER_POOL */
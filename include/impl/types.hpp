@@ -3,6 +3,8 @@
 
 #include "msgpack.hpp"
 #include <cstdint>
+#include <memory_resource>
+#include <string>
 
 namespace nvimRpc {
 namespace types {
@@ -12,4 +14,37 @@ using Array = std::map<std::string, msgpack::type::variant>;
 } // namespace types
 } // namespace nvimRpc
 
+// msgpack only knows about std::string, teach it std::pmr::string so results
+// can be decoded into containers allocated from a caller provided resource
+namespace msgpack {
+MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS) {
+  namespace adaptor {
+  template <> struct convert<std::pmr::string> {
+    const msgpack::object &operator()(const msgpack::object &o, std::pmr::string &v) const {
+      switch (o.type) {
+      case msgpack::type::BIN:
+        v.assign(o.via.bin.ptr, o.via.bin.size);
+        break;
+      case msgpack::type::STR:
+        v.assign(o.via.str.ptr, o.via.str.size);
+        break;
+      default:
+        throw msgpack::type_error();
+      }
+      return o;
+    }
+  };
+
+  template <> struct pack<std::pmr::string> {
+    template <typename Stream>
+    msgpack::packer<Stream> &operator()(msgpack::packer<Stream> &o, const std::pmr::string &v) const {
+      o.pack_str(static_cast<uint32_t>(v.size()));
+      o.pack_str_body(v.data(), static_cast<uint32_t>(v.size()));
+      return o;
+    }
+  };
+  } // namespace adaptor
+}
+} // namespace msgpack
+
 #endif /* !NVIM_CLIENT_TYPES */
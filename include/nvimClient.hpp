@@ -1,10 +1,16 @@
 #ifndef NVIM_CLIENT_LIB
 #define NVIM_CLIENT_LIB
 
+#include "impl/BufferDiff.hpp"
 #include "impl/CallDispatcher.hpp"
 #include "impl/Client.hpp"
+#include "impl/MemoryResource.hpp"
 #include "impl/MsgPacker.hpp"
+#include "impl/PreparedLua.hpp"
+#include "impl/Redraw.hpp"
 #include "impl/TcpConnector.hpp"
+#include "impl/Trace.hpp"
+#include "impl/WorkerPool.hpp"
 #include "impl/types.hpp"
 
 #endif /* !NVIM_CLIENT_LIB */
@@ -1,16 +1,16 @@
-const { getFormattedType } = require('./types');
+const { getFormattedType, getFormattedParameterType, getParameterDeclaration } = require('./types');
 
 function getFunctionParameters(fnParams) {
     return fnParams.map(fnParam => ({
         name: fnParam[1],
-        type: getFormattedType(fnParam[0]),
+        type: getFormattedParameterType(fnParam[0]),
     }));
 }
 
 function listParameters(functionParams, includeParamsTypes = false) {
     const paramsList = functionParams.map(
         functionParam =>
-        `${includeParamsTypes? functionParam.type + ' ' : ''}${functionParam.name}`
+        `${includeParamsTypes? getParameterDeclaration(functionParam.type) + ' ' : ''}${functionParam.name}`
     );
 
     return paramsList.join(', ');
@@ -27,7 +27,11 @@ function getFunctionHeader(fnType, fnName, fnParams) {
     return `std::future<${fnType}> ${fnName}(${listParameters(fnParams, true)})`
 }
 
-function getFunctionImplementation(fnName, fnType, fnParams) {
+function getSyncFunctionHeader(fnType, fnName, fnParams) {
+    return `${fnType} ${fnName}_sync(${listParameters(fnParams, true)})`
+}
+
+function getFunctionImplementation(fnName, fnType, fnParams, placeCall = 'placeCall') {
     const listedParams = listParameters(fnParams);
     const listedParamsTypes = listParametersTypes(fnParams);
 
@@ -35,7 +39,7 @@ function getFunctionImplementation(fnName, fnType, fnParams) {
 auto packedRequest = _packRequest("${fnName}"${listedParams.length ? ', ' + listedParams : ''});
 
 
-return _dispatcher->placeCall<${fnType}${listedParamsTypes.length ? ', ' + listedParamsTypes : ''}>(packedRequest);
+return _dispatcher->${placeCall}<${fnType}${listedParamsTypes.length ? ', ' + listedParamsTypes : ''}>(packedRequest);
 `;
 }
 
@@ -52,6 +56,10 @@ function defineFunctions(apiInfo) {
 ${getFunctionHeader(fnType, fn.name, fnParams)} {
     ${getFunctionImplementation(fn.name, fnType, fnParams)}
 }
+
+${getSyncFunctionHeader(fnType, fn.name, fnParams)} {
+    ${getFunctionImplementation(fn.name, fnType, fnParams, 'placeCallSync')}
+}
 `;
     });
 
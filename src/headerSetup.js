@@ -2,14 +2,26 @@ function headerSetup() {
     return `
 #ifndef NVIM_CLIENT
 #define NVIM_CLIENT
+#include <atomic>
 #include <exception>
+#include <future>
 #include <iostream>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <utility>
 
+#include "impl/BufferDiff.hpp"
+#include "impl/MemoryResource.hpp"
 #include "impl/MsgPacker.hpp"
+#include "impl/PreparedLua.hpp"
+#include "impl/Redraw.hpp"
 #include "impl/TcpConnector.hpp"
+#include "impl/Trace.hpp"
 #include "impl/types.hpp"
 #include "impl/CallDispatcher.hpp"
 #include "msgpack.hpp"
@@ -35,20 +47,105 @@ namespace nvimRpc {
 			Tcp::Connector* _connector;
 			dispatcher::CallDispatcher* _dispatcher;
 			std::thread _dispatcherThread;
-			uint64_t _msgid;
+			std::atomic<std::pmr::memory_resource*> _resource;
+			std::atomic<uint64_t> _msgid;
+			std::set<std::string> _preparedChunks;
+			std::mutex _preparedChunks_mtx;
 
-			template<typename... U>
+			// requests packed with COPIED copy all of their arguments, see packer::CopiedArguments
+			template<bool COPIED = false, typename... U>
 				std::shared_ptr<packer::PackedRequest<U...>> _packRequest(const std::string& method, const U&... args) {
-					return std::shared_ptr<packer::PackedRequest<U...>>(new packer::PackedRequest<U...>(method, _msgid++, args...));
+					uint64_t msgid = _msgid.fetch_add(1);
+					std::pmr::memory_resource* resource = _resource.load();
+					std::pmr::polymorphic_allocator<packer::PackedRequest<U...>> allocator(resource);
+					std::shared_ptr<packer::PackedRequest<U...>> packedRequest;
+
+					trace::record(msgid, trace::PACKING);
+					if constexpr (COPIED) {
+						packedRequest = std::allocate_shared<packer::PackedRequest<U...>>(
+								allocator, packer::CopiedArguments(), method, msgid, resource, args...);
+					} else {
+						packedRequest = std::allocate_shared<packer::PackedRequest<U...>>(
+								allocator, method, msgid, resource, args...);
+					}
+					trace::recordPacked(msgid, method, packedRequest->size());
+
+					return packedRequest;
+				}
+
+			// marks the chunk as registered on nvim's side, returns whether it already was
+			bool _markPrepared(const std::string& key) {
+				std::lock_guard lockPreparedChunks(_preparedChunks_mtx);
+
+				return !_preparedChunks.insert(key).second;
+			}
+
+			template<typename T, typename... U>
+				std::future<T> _prepareAndCallLua(const lua::PreparedChunk& chunk, const U&... args) {
+					return call<T>("nvim_exec_lua", std::string(lua::PREPARE_AND_CALL),
+							std::tuple<const std::string&, const std::string&, const U&...>(chunk.key(), chunk.code(), args...));
+				}
+
+			// Places request, a CALL_PREPARED of chunk, fulfilling result. If nvim lost the chunk it is registered
+			// then request is placed again, under the same id as its previous call is over by then.
+			template<typename T, typename... U>
+				void _placePrepared(const std::shared_ptr<std::promise<T>>& result,
+						const std::shared_ptr<packer::PackedRequest<U...>>& request, const lua::PreparedChunk& chunk,
+						bool registered = false) {
+					_dispatcher->placeCallback<U...>(request,
+							[this, result, request, chunk, registered](const packer::PackedRequestResponse& response) {
+								try {
+									result->set_value(dispatcher::decodeResponse<T>(response, request->resource()));
+									return;
+								} catch (std::runtime_error& e) {
+									if (registered || !lua::isUnprepared(e)) {
+										result->set_exception(std::current_exception());
+										return;
+									}
+								} catch (std::exception&) {
+									result->set_exception(std::current_exception());
+									return;
+								}
+								try {
+									callWithHandler("nvim_exec_lua",
+											[this, result, request, chunk](const packer::PackedRequestResponse& registration) {
+												try {
+													packer::Error error;
+
+													if (registration.error(error)) {
+														throw std::runtime_error(std::get<1>(error));
+													}
+													_placePrepared<T>(result, request, chunk, true);
+												} catch (std::exception&) {
+													result->set_exception(std::current_exception());
+												}
+											},
+											std::string(lua::PREPARE),
+											std::tuple<const std::string&, const std::string&>(chunk.key(), chunk.code()));
+								} catch (std::exception&) {
+									result->set_exception(std::current_exception());
+								}
+							});
 				}
 		public:
-			Client(Tcp::Connector* connector) {
+			// resource backs the packed requests, the calls waiting for their response, their promises and the
+			// decoded results. Several of the dispatcher's workers allocate from it at the same time, so it must be
+			// thread safe: std::pmr::synchronized_pool_resource, std::pmr::new_delete_resource(), or any other
+			// resource wrapped in a memory::SynchronizedResource.
+			Client(Tcp::Connector* connector, size_t workerCount = std::thread::hardware_concurrency(),
+					std::pmr::memory_resource* resource = std::pmr::get_default_resource()) {
 				this->_connector = connector;
-				this->_dispatcher = new dispatcher::CallDispatcher(connector);
+				this->_dispatcher = new dispatcher::CallDispatcher(connector, workerCount, resource);
+				this->_resource = resource;
 				this->_msgid = 0;
 			};
 
 			void connect() {
+				{
+					std::lock_guard lockPreparedChunks(_preparedChunks_mtx);
+
+					_preparedChunks.clear();
+				}
 				_connector->connect();
 				_dispatcherThread = dispatcher::CallDispatcher::startCallDispatcher(_dispatcher);
 
@@ -59,6 +156,132 @@ namespace nvimRpc {
 				_dispatcherThread.join();
 			}
 
+			// only affects the calls placed after it, e.g. to switch to a new arena per batch of calls. Same
+			// thread safety requirement as the constructor's resource.
+			void setMemoryResource(std::pmr::memory_resource* resource) {
+				_resource.store(resource);
+			}
+
+			std::pmr::memory_resource* memoryResource() const {
+				return _resource.load();
+			}
+
+			// untyped entry point for callers picking their own result type, e.g.
+			// call<std::pmr::vector<std::pmr::string>>("nvim_buf_get_lines", ...) to
+			// decode into memory from the client's resource
+			template<typename T, typename... U>
+				std::future<T> call(const std::string& method, const U&... args) {
+					auto packedRequest = _packRequest(method, args...);
+
+					return _dispatcher->placeCall<T, U...>(packedRequest);
+				}
+
+			// blocking counterpart of call(), see CallDispatcher::placeCallSync
+			template<typename T, typename... U>
+				T callSync(const std::string& method, const U&... args) {
+					auto packedRequest = _packRequest(method, args...);
+
+					return _dispatcher->placeCallSync<T, U...>(packedRequest);
+				}
+
+			// Places the call and hands its undecoded response to handler, on the dispatcher worker receiving it
+			template<typename... U>
+				void callWithHandler(const std::string& method, dispatcher::ResponseHandler handler, const U&... args) {
+					auto packedRequest = _packRequest(method, args...);
+
+					_dispatcher->placeCallback<U...>(packedRequest, std::move(handler));
+				}
+
+			// Makes desired the content of buffer (0 for the current one) by sending only the changed regions, as a
+			// single nvim_call_atomic. current must be the buffer's content as nvim has it. Given the changedtick
+			// current was read at, nothing is applied if the buffer changed since. The future holds the results of
+			// the edits, or a std::runtime_error if nvim stopped at one of them.
+			std::future<std::vector<msgpack::type::variant>> setBufferLines(
+					int64_t buffer, const diff::Lines& current, const diff::Lines& desired, int64_t changedtick = -1) {
+				auto results = std::make_shared<std::promise<std::vector<msgpack::type::variant>>>();
+				diff::BufferEdits bufferEdits{buffer, diff::computeEdits(current, desired), changedtick};
+				bool guarded = changedtick >= 0;
+
+				if (bufferEdits.edits.empty()) {
+					results->set_value(std::vector<msgpack::type::variant>());
+					return results->get_future();
+				}
+				callWithHandler("nvim_call_atomic", [results, guarded](const packer::PackedRequestResponse& response) {
+					try {
+						packer::Error error;
+
+						if (response.error(error)) {
+							throw std::runtime_error(std::get<1>(error));
+						}
+						results->set_value(diff::editResults(response.result(), guarded));
+					} catch (std::exception&) {
+						results->set_exception(std::current_exception());
+					}
+				}, bufferEdits);
+				return results->get_future();
+			}
+
+			// Same as above, blocks while fetching the buffer's content first. The changedtick is read along with
+			// it, so edits made to the buffer in between are never overwritten.
+			std::future<std::vector<msgpack::type::variant>> setBufferLines(int64_t buffer, const diff::Lines& desired) {
+				auto current = call<std::tuple<int64_t, diff::Lines>>("nvim_exec_lua",
+						std::string(diff::GET_LINES_WITH_CHANGEDTICK), std::make_tuple(buffer)).get();
+
+				return setBufferLines(buffer, std::get<1>(current), desired, std::get<0>(current));
+			}
+
+			// Feeds ui with the redraw notifications and attaches it to nvim, ext_linegrid is always requested
+			std::future<packer::Void> attachUi(redraw::Ui& ui, int64_t width, int64_t height,
+					std::map<std::string, bool> options = std::map<std::string, bool>()) {
+				options["ext_linegrid"] = true;
+				onNotification("redraw", [&ui](const packer::PackedRequestResponse& notification) {
+					ui.handleRedraw(notification.params());
+				});
+
+				return call<packer::Void>("nvim_ui_attach", width, height, options);
+			}
+
+			// Runs the Lua chunk with args, as nvim_exec_lua would. The chunk is registered in nvim (keyed by its
+			// content hash) along with its first call, later calls only send its key and args. Those calls copy their
+			// args into the packed request rather than referencing them, so that if nvim lost the chunk (restart...)
+			// the worker receiving the failure can register it and send the request again before fulfilling the future.
+			template<typename T, typename... U>
+				std::future<T> callPrepared(const lua::PreparedChunk& chunk, const U&... args) {
+					if (!_markPrepared(chunk.key())) {
+						return _prepareAndCallLua<T>(chunk, args...);
+					}
+
+					auto result = std::make_shared<std::promise<T>>();
+					auto request = _packRequest<true>("nvim_exec_lua", std::string(lua::CALL_PREPARED),
+							std::tuple<const std::string&, const U&...>(chunk.key(), args...));
+					_placePrepared<T>(result, request, chunk);
+					return result->get_future();
+				}
+
+			// Opt-in lifecycle tracing of one request out of sampleEvery, see trace::Tracer. Futures consumed
+			// outside of the client can't be observed, only _sync calls record their consumption.
+			void enableTracing(uint32_t sampleEvery = 1) {
+				trace::Tracer::instance().enable(sampleEvery);
+			}
+
+			void disableTracing() {
+				trace::Tracer::instance().disable();
+			}
+
+			void exportTrace(std::ostream& out) {
+				trace::Tracer::instance().exportChromeTrace(out);
+			}
+
+			// handlers are run one at a time, in the order the notifications were received
+			void onNotification(const std::string& method, dispatcher::NotificationHandler handler) {
+				_dispatcher->onNotification(method, handler);
+			}
+
+			// serves rpcrequest() calls made from nvim, handlers run concurrently on their own worker pool
+			void onRequest(const std::string& method, dispatcher::RequestHandler handler) {
+				_dispatcher->onRequest(method, handler);
+			}
+
     `;
 }
 
@@ -28,6 +28,27 @@ function getFormattedType(type) {
     return nvimTypesMapping[type] || nvimDefaultTypeMapping;
 }
 
+// Parameters are views or references on the caller's memory, large strings
+// are sent from there without being copied (see PackedRequest)
+const parameterTypesMapping = Object.freeze({
+    'std::string': 'std::string_view',
+});
+const passedByValue = ['bool', 'int64_t', 'double', 'std::string_view'];
+
+function getFormattedParameterType(type) {
+    const formattedType = getFormattedType(type);
+
+    return parameterTypesMapping[formattedType] || formattedType;
+}
+
+function getParameterDeclaration(formattedParameterType) {
+    return passedByValue.includes(formattedParameterType)
+        ? formattedParameterType
+        : `const ${formattedParameterType} &`;
+}
+
 module.exports = {
     getFormattedType,
+    getFormattedParameterType,
+    getParameterDeclaration,
 };